@@ -0,0 +1,279 @@
+#ifndef BIT_OPS_H_INCLUDED
+#define BIT_OPS_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#if defined(_MSC_VER)
+#include <template\table.h>
+#include <algorithm\CpuFeatures.h>
+#elif defined(__GNUC__)
+#include <template/table.h>
+#include <algorithm/CpuFeatures.h>
+#else
+#error unsupported compiler
+#endif
+#if defined(CPU_FEATURES_X86)
+#include <immintrin.h>
+#endif
+
+class BitOps
+{
+    /**
+    *bit counting and bit reversal over whole buffers. the kernel is picked
+    *once from the cpu: a Harley-Seal carry save adder over AVX2 registers or
+    *POPCNT for counting, PSHUFB nibble tables for reversing, and portable
+    *64 bit code elsewhere. buffers need no alignment
+    */
+public:
+    /**
+    *the number of set bits in len bytes of buf
+    */
+    static unsigned long long Count(const void *buf, size_t len)
+    {
+#if defined(CPU_FEATURES_X86)
+        static const CountKernel kernel = CpuFeatures::HasAVX2() ? &CountAVX2 : CpuFeatures::HasPOPCNT() ? &CountPOPCNT : &CountScalar;
+#else
+        static const CountKernel kernel = &CountScalar;
+#endif
+        return kernel(static_cast<const unsigned char*>(buf), len);
+    }
+
+    /**
+    *reverse the bit order of count numbers of width bytes each (1, 2, 4 or 8)
+    *from src into dst, which may be src itself
+    */
+    static void Reverse(void *dst, const void *src, size_t count, size_t width)
+    {
+#if defined(CPU_FEATURES_X86)
+        static const ReverseKernel kernel = CpuFeatures::HasAVX2() ? &ReverseAVX2 : CpuFeatures::HasSSSE3() ? &ReverseSSSE3 : &ReverseScalar;
+#else
+        static const ReverseKernel kernel = &ReverseScalar;
+#endif
+        kernel(static_cast<unsigned char*>(dst), static_cast<const unsigned char*>(src), count * width, width);
+    }
+
+    /**
+    *the index of the lowest set bit, word must not be 0
+    */
+    static int TrailingZeros(uint64_t word)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return (int)index;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, (unsigned long)word)) {
+            return (int)index;
+        }
+        _BitScanForward(&index, (unsigned long)(word >> 32));
+        return (int)index + 32;
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    /**
+    *the kernels by name, for tests and benchmarks, only call those the cpu has
+    */
+    typedef unsigned long long(*CountKernel)(const unsigned char *buf, size_t len);
+    typedef void(*ReverseKernel)(unsigned char *dst, const unsigned char *src, size_t len, size_t width);
+
+    static unsigned long long CountScalar(const unsigned char *buf, size_t len)
+    {
+        unsigned long long count = 0;
+        for (; len >= 8; buf += 8, len -= 8) {
+            uint64_t word;
+            memcpy(&word, buf, sizeof(word));
+            count += CountWord(word);
+        }
+        if (len) {
+            uint64_t word = 0;
+            memcpy(&word, buf, len);
+            count += CountWord(word);
+        }
+        return count;
+    }
+
+    /**
+    *len bytes as width byte numbers, each byte through a table and the bytes
+    *of a number in reverse order
+    */
+    static void ReverseScalar(unsigned char *dst, const unsigned char *src, size_t len, size_t width)
+    {
+        const stdex::table<unsigned char, 256> &table = stdex::static_table<unsigned char, 256, stdex::bit_reverse_gen>::value;
+        for (; len >= width; dst += width, src += width, len -= width) {
+            unsigned char number[8];
+            memcpy(number, src, width);
+            for (size_t i = 0; i < width; ++i) {
+                dst[i] = table[number[width - 1 - i]];
+            }
+        }
+    }
+
+#if defined(CPU_FEATURES_X86)
+    CPU_TARGET("popcnt")
+    static unsigned long long CountPOPCNT(const unsigned char *buf, size_t len)
+    {
+        unsigned long long count1 = 0, count2 = 0;
+        for (; len >= 16; buf += 16, len -= 16) {
+            uint64_t one, two;
+            memcpy(&one, buf, sizeof(one));
+            memcpy(&two, buf + 8, sizeof(two));
+            count1 += PopCnt(one);
+            count2 += PopCnt(two);
+        }
+        return count1 + count2 + CountScalar(buf, len);
+    }
+
+    /**
+    *sixteen registers at a time go through a tree of carry save adders, so
+    *only one register in sixteen has its bits counted (Harley-Seal, see
+    *Mula, Kurz and Lemire, "Faster Population Counts Using AVX2 Instructions")
+    */
+    CPU_TARGET("avx2")
+    static unsigned long long CountAVX2(const unsigned char *buf, size_t len)
+    {
+        const __m256i *data = (const __m256i*)buf;
+        __m256i total = _mm256_setzero_si256();
+        __m256i ones = _mm256_setzero_si256();
+        __m256i twos = _mm256_setzero_si256();
+        __m256i fours = _mm256_setzero_si256();
+        __m256i eights = _mm256_setzero_si256();
+        __m256i sixteens, twos_a, twos_b, fours_a, fours_b, eights_a, eights_b;
+        for (; len >= 512; data += 16, len -= 512) {
+            CarrySaveAdd(twos_a, ones, ones, Load(data + 0), Load(data + 1));
+            CarrySaveAdd(twos_b, ones, ones, Load(data + 2), Load(data + 3));
+            CarrySaveAdd(fours_a, twos, twos, twos_a, twos_b);
+            CarrySaveAdd(twos_a, ones, ones, Load(data + 4), Load(data + 5));
+            CarrySaveAdd(twos_b, ones, ones, Load(data + 6), Load(data + 7));
+            CarrySaveAdd(fours_b, twos, twos, twos_a, twos_b);
+            CarrySaveAdd(eights_a, fours, fours, fours_a, fours_b);
+            CarrySaveAdd(twos_a, ones, ones, Load(data + 8), Load(data + 9));
+            CarrySaveAdd(twos_b, ones, ones, Load(data + 10), Load(data + 11));
+            CarrySaveAdd(fours_a, twos, twos, twos_a, twos_b);
+            CarrySaveAdd(twos_a, ones, ones, Load(data + 12), Load(data + 13));
+            CarrySaveAdd(twos_b, ones, ones, Load(data + 14), Load(data + 15));
+            CarrySaveAdd(fours_b, twos, twos, twos_a, twos_b);
+            CarrySaveAdd(eights_b, fours, fours, fours_a, fours_b);
+            CarrySaveAdd(sixteens, eights, eights, eights_a, eights_b);
+            total = _mm256_add_epi64(total, Count256(sixteens));
+        }
+        total = _mm256_slli_epi64(total, 4);
+        total = _mm256_add_epi64(total, _mm256_slli_epi64(Count256(eights), 3));
+        total = _mm256_add_epi64(total, _mm256_slli_epi64(Count256(fours), 2));
+        total = _mm256_add_epi64(total, _mm256_slli_epi64(Count256(twos), 1));
+        total = _mm256_add_epi64(total, Count256(ones));
+        for (; len >= 32; ++data, len -= 32) {
+            total = _mm256_add_epi64(total, Count256(Load(data)));
+        }
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, total);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + CountScalar((const unsigned char*)data, len);
+    }
+
+    CPU_TARGET("ssse3")
+    static void ReverseSSSE3(unsigned char *dst, const unsigned char *src, size_t len, size_t width)
+    {
+        const __m128i low = _mm_set1_epi8(0x0f);
+        const __m128i reverse_low = _mm_setr_epi8(0x00, (char)0x80, 0x40, (char)0xc0, 0x20, (char)0xa0, 0x60, (char)0xe0,
+            0x10, (char)0x90, 0x50, (char)0xd0, 0x30, (char)0xb0, 0x70, (char)0xf0);
+        const __m128i reverse_high = _mm_setr_epi8(0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+            0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f);
+        const __m128i order = _mm_loadu_si128((const __m128i*)ByteOrder(width));
+        for (; len >= 16; dst += 16, src += 16, len -= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)src);
+            __m128i bits = _mm_or_si128(_mm_shuffle_epi8(reverse_low, _mm_and_si128(v, low)),
+                _mm_shuffle_epi8(reverse_high, _mm_and_si128(_mm_srli_epi16(v, 4), low)));
+            _mm_storeu_si128((__m128i*)dst, _mm_shuffle_epi8(bits, order));
+        }
+        ReverseScalar(dst, src, len, width);
+    }
+
+    CPU_TARGET("avx2")
+    static void ReverseAVX2(unsigned char *dst, const unsigned char *src, size_t len, size_t width)
+    {
+        const __m256i low = _mm256_set1_epi8(0x0f);
+        const __m256i reverse_low = _mm256_setr_epi8(0x00, (char)0x80, 0x40, (char)0xc0, 0x20, (char)0xa0, 0x60, (char)0xe0,
+            0x10, (char)0x90, 0x50, (char)0xd0, 0x30, (char)0xb0, 0x70, (char)0xf0,
+            0x00, (char)0x80, 0x40, (char)0xc0, 0x20, (char)0xa0, 0x60, (char)0xe0,
+            0x10, (char)0x90, 0x50, (char)0xd0, 0x30, (char)0xb0, 0x70, (char)0xf0);
+        const __m256i reverse_high = _mm256_setr_epi8(0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+            0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f,
+            0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e,
+            0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f);
+        //vpshufb works within each 16 byte half, so the same order serves both
+        const __m256i order = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ByteOrder(width)));
+        for (; len >= 32; dst += 32, src += 32, len -= 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)src);
+            __m256i bits = _mm256_or_si256(_mm256_shuffle_epi8(reverse_low, _mm256_and_si256(v, low)),
+                _mm256_shuffle_epi8(reverse_high, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+            _mm256_storeu_si256((__m256i*)dst, _mm256_shuffle_epi8(bits, order));
+        }
+        ReverseScalar(dst, src, len, width);
+    }
+#endif
+
+private:
+    static unsigned long long CountWord(uint64_t word)
+    {
+        word = word - ((word >> 1) & 0x5555555555555555ull);
+        word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+        word = (word + (word >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (word * 0x0101010101010101ull) >> 56;
+    }
+
+#if defined(CPU_FEATURES_X86)
+    CPU_TARGET("popcnt")
+    static unsigned long long PopCnt(uint64_t word)
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        return _mm_popcnt_u64(word);
+#else
+        return _mm_popcnt_u32((unsigned int)word) + _mm_popcnt_u32((unsigned int)(word >> 32));
+#endif
+    }
+
+    CPU_TARGET("avx2")
+    static __m256i Load(const __m256i *p)
+    {
+        return _mm256_loadu_si256(p);
+    }
+
+    //high gets the carries of a + b + c, low the sum bits
+    CPU_TARGET("avx2")
+    static void CarrySaveAdd(__m256i &high, __m256i &low, __m256i a, __m256i b, __m256i c)
+    {
+        __m256i u = _mm256_xor_si256(a, b);
+        high = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(u, c));
+        low = _mm256_xor_si256(u, c);
+    }
+
+    //bits set in each 64 bit lane: nibble table lookups summed with vpsadbw
+    CPU_TARGET("avx2")
+    static __m256i Count256(__m256i v)
+    {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low = _mm256_set1_epi8(0x0f);
+        __m256i count = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+            _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+        return _mm256_sad_epu8(count, _mm256_setzero_si256());
+    }
+
+    //the byte shuffle reversing each width byte number of 16 bytes
+    static const unsigned char *ByteOrder(size_t width)
+    {
+        static const unsigned char orders[4][16] = {
+            { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+            { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+            { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+            { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+        };
+        return orders[width == 8 ? 3 : width == 4 ? 2 : width == 2 ? 1 : 0];
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef BIT_SET_H_INCLUDED
+#define BIT_SET_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#if defined(_MSC_VER)
+#include <algorithm\BitOps.h>
+#elif defined(__GNUC__)
+#include <algorithm/BitOps.h>
+#else
+#error unsupported compiler
+#endif
+
+template <size_t Bits>
+class BitSet
+{
+    /**
+    *a fixed set of Bits flags in 64 bit words, for membership over port or
+    *host ranges: PortSet holds all 65536 ports, HostSet16 the hosts of a /16.
+    *Count() goes through BitOps, so a whole set is counted with AVX2 or POPCNT.
+    *not thread safe, give each thread its own and merge them with |=
+    */
+public:
+    static const size_t Words = (Bits + 63) / 64;
+
+    BitSet()
+    {
+        Clear();
+    }
+
+    size_t Size() const
+    {
+        return Bits;
+    }
+
+    bool Test(size_t index) const
+    {
+        return (words[index >> 6] >> (index & 63)) & 1;
+    }
+
+    void Set(size_t index)
+    {
+        words[index >> 6] |= 1ull << (index & 63);
+    }
+
+    void Set(size_t index, bool value)
+    {
+        value ? Set(index) : Reset(index);
+    }
+
+    /**
+    *set the indexes from first up to but not including last
+    */
+    void SetRange(size_t first, size_t last)
+    {
+        for (; first < last && (first & 63); ++first) {
+            Set(first);
+        }
+        for (; first + 64 <= last; first += 64) {
+            words[first >> 6] = ~0ull;
+        }
+        for (; first < last; ++first) {
+            Set(first);
+        }
+    }
+
+    void Reset(size_t index)
+    {
+        words[index >> 6] &= ~(1ull << (index & 63));
+    }
+
+    void Clear()
+    {
+        memset(words, 0, sizeof(words));
+    }
+
+    void Fill()
+    {
+        memset(words, 0xff, sizeof(words));
+        if (Bits & 63) {
+            words[Words - 1] = (1ull << (Bits & 63)) - 1;
+        }
+    }
+
+    /**
+    *the number of indexes set
+    */
+    size_t Count() const
+    {
+        return (size_t)BitOps::Count(words, sizeof(words));
+    }
+
+    bool Any() const
+    {
+        for (size_t i = 0; i < Words; ++i) {
+            if (words[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool None() const
+    {
+        return !Any();
+    }
+
+    /**
+    *the first index set at or after from, Size() when there is none.
+    *for (size_t i = set.Next(0); i < set.Size(); i = set.Next(i + 1)) visits them all
+    */
+    size_t Next(size_t from) const
+    {
+        if (from >= Bits) {
+            return Bits;
+        }
+        size_t word = from >> 6;
+        uint64_t bits = words[word] & (~0ull << (from & 63));
+        while (!bits) {
+            if (++word == Words) {
+                return Bits;
+            }
+            bits = words[word];
+        }
+        return (word << 6) + BitOps::TrailingZeros(bits);
+    }
+
+    BitSet &operator|=(const BitSet &other)
+    {
+        for (size_t i = 0; i < Words; ++i) {
+            words[i] |= other.words[i];
+        }
+        return *this;
+    }
+
+    BitSet &operator&=(const BitSet &other)
+    {
+        for (size_t i = 0; i < Words; ++i) {
+            words[i] &= other.words[i];
+        }
+        return *this;
+    }
+
+    /**
+    *remove the indexes set in other, the ports already answered for example
+    */
+    BitSet &Remove(const BitSet &other)
+    {
+        for (size_t i = 0; i < Words; ++i) {
+            words[i] &= ~other.words[i];
+        }
+        return *this;
+    }
+
+    bool operator==(const BitSet &other) const
+    {
+        return memcmp(words, other.words, sizeof(words)) == 0;
+    }
+
+    bool operator!=(const BitSet &other) const
+    {
+        return !(*this == other);
+    }
+
+    /**
+    *the words, index i is bit i % 64 of word i / 64
+    */
+    const uint64_t *Data() const
+    {
+        return words;
+    }
+
+private:
+    uint64_t words[Words];
+};
+
+typedef BitSet<65536> PortSet;
+typedef BitSet<65536> HostSet16;
+
+#endif
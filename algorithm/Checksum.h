@@ -0,0 +1,157 @@
+#ifndef CHECKSUM_H_INCLUDED
+#define CHECKSUM_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#if defined(_MSC_VER)
+#include <algorithm\CpuFeatures.h>
+#elif defined(__GNUC__)
+#include <algorithm/CpuFeatures.h>
+#else
+#error unsupported compiler
+#endif
+#if defined(CPU_FEATURES_X86)
+#include <immintrin.h>
+#endif
+
+class Checksum
+{
+    /**
+    *the internet checksum (RFC 1071) of IP, ICMP, TCP and UDP. words are
+    *summed as they lie in memory, so the result is stored back as it is, no
+    *byte swapping on either side. sums are kept unfolded in 64 bits while
+    *buffers are added, AVX2 takes 64 bytes a step when the cpu has it, and
+    *the loads have no alignment needs
+    */
+public:
+    /**
+    *add len bytes of buf to the running sum, every buffer but the last must
+    *have an even length
+    */
+    static uint64_t Add(const void *buf, size_t len, uint64_t sum = 0)
+    {
+#if defined(CPU_FEATURES_X86)
+        static const Kernel kernel = CpuFeatures::HasAVX2() ? &AddAVX2 : &AddScalar;
+#else
+        static const Kernel kernel = &AddScalar;
+#endif
+        return kernel(static_cast<const unsigned char*>(buf), len, sum);
+    }
+
+    /**
+    *the sum folded to 16 bits with the carries added back
+    */
+    static uint16_t Fold(uint64_t sum)
+    {
+        sum = (sum >> 32) + (sum & 0xffffffff);
+        sum = (sum >> 32) + (sum & 0xffffffff);
+        sum = (sum >> 16) + (sum & 0xffff);
+        sum = (sum >> 16) + (sum & 0xffff);
+        return (uint16_t)sum;
+    }
+
+    /**
+    *the checksum of buf, what goes in the checksum field
+    */
+    static uint16_t Compute(const void *buf, size_t len)
+    {
+        return (uint16_t)~Fold(Add(buf, len));
+    }
+
+    /**
+    *the checksum after one 16 bit word of the covered data changed from
+    *old_value to new_value, without summing the data again (RFC 1624,
+    *HC' = ~(~HC + ~m + m')). all three as they lie in the packet
+    */
+    static uint16_t Update16(uint16_t check, uint16_t old_value, uint16_t new_value)
+    {
+        uint64_t sum = (uint16_t)~check;
+        sum += (uint16_t)~old_value;
+        sum += new_value;
+        return (uint16_t)~Fold(sum);
+    }
+
+    /**
+    *the same for a 32 bit field such as a sequence number or an address
+    */
+    static uint16_t Update32(uint16_t check, uint32_t old_value, uint32_t new_value)
+    {
+        uint64_t sum = (uint16_t)~check;
+        sum += (uint16_t)~(old_value >> 16);
+        sum += (uint16_t)~old_value;
+        sum += new_value >> 16;
+        sum += new_value & 0xffff;
+        return (uint16_t)~Fold(sum);
+    }
+
+    /**
+    *the kernels by name, for tests and benchmarks, AddAVX2 only when
+    *CpuFeatures::HasAVX2()
+    */
+    typedef uint64_t(*Kernel)(const unsigned char *buf, size_t len, uint64_t sum);
+
+    /**
+    *32 bit words into a 64 bit sum, the carries stay in the upper half until Fold
+    */
+    static uint64_t AddScalar(const unsigned char *buf, size_t len, uint64_t sum)
+    {
+        uint64_t sum2 = 0;
+        for (; len >= 16; buf += 16, len -= 16) {
+            uint64_t one, two;
+            memcpy(&one, buf, sizeof(one));
+            memcpy(&two, buf + 8, sizeof(two));
+            sum += (one & 0xffffffff) + (one >> 32);
+            sum2 += (two & 0xffffffff) + (two >> 32);
+        }
+        sum += sum2;
+        for (; len >= 4; buf += 4, len -= 4) {
+            uint32_t word;
+            memcpy(&word, buf, sizeof(word));
+            sum += word;
+        }
+        if (len >= 2) {
+            uint16_t word;
+            memcpy(&word, buf, sizeof(word));
+            sum += word;
+            buf += 2;
+            len -= 2;
+        }
+        if (len) {
+            //the odd byte is the first of a word padded with zero
+            uint16_t word = 0;
+            memcpy(&word, buf, 1);
+            sum += word;
+        }
+        return sum;
+    }
+
+#if defined(CPU_FEATURES_X86)
+    /**
+    *each 32 bit word is widened into one of four 64 bit lanes
+    */
+    CPU_TARGET("avx2")
+    static uint64_t AddAVX2(const unsigned char *buf, size_t len, uint64_t sum)
+    {
+        if (len >= 64) {
+            const __m256i low = _mm256_set1_epi64x(0xffffffff);
+            __m256i acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256();
+            for (; len >= 64; buf += 64, len -= 64) {
+                __m256i one = _mm256_loadu_si256((const __m256i*)buf);
+                __m256i two = _mm256_loadu_si256((const __m256i*)(buf + 32));
+                acc1 = _mm256_add_epi64(acc1, _mm256_add_epi64(_mm256_and_si256(one, low), _mm256_srli_epi64(one, 32)));
+                acc2 = _mm256_add_epi64(acc2, _mm256_add_epi64(_mm256_and_si256(two, low), _mm256_srli_epi64(two, 32)));
+            }
+            acc1 = _mm256_add_epi64(acc1, acc2);
+            __m128i half = _mm_add_epi64(_mm256_castsi256_si128(acc1), _mm256_extracti128_si256(acc1, 1));
+            uint64_t lanes[2];
+            _mm_storeu_si128((__m128i*)lanes, half);
+            sum += lanes[0] + lanes[1];
+        }
+        return AddScalar(buf, len, sum);
+    }
+#endif
+};
+
+#endif
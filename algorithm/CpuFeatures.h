@@ -0,0 +1,115 @@
+#ifndef CPU_FEATURES_H_INCLUDED
+#define CPU_FEATURES_H_INCLUDED
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_FEATURES_X86
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+//msvc compiles any intrinsic without switches
+#define CPU_TARGET(features)
+#elif defined(__GNUC__)
+#if defined(CPU_FEATURES_X86)
+#include <cpuid.h>
+#endif
+//lets one function use instructions the rest of the build does not assume
+#define CPU_TARGET(features) __attribute__((target(features)))
+#else
+#error unsupported compiler
+#endif
+
+class CpuFeatures
+{
+    /**
+    *the instruction set extensions of the cpu we run on, read once with cpuid.
+    *code using them keeps a portable path and picks the fast one at runtime.
+    *all false on other architectures
+    */
+public:
+    static bool HasSSSE3() { return Get().ssse3; }
+    static bool HasSSE41() { return Get().sse41; }
+    static bool HasSSE42() { return Get().sse42; }
+    static bool HasPOPCNT() { return Get().popcnt; }
+    static bool HasPCLMUL() { return Get().pclmul; }
+    static bool HasAESNI() { return Get().aesni; }
+    /**
+    *also checks the os saves the ymm registers
+    */
+    static bool HasAVX2() { return Get().avx2; }
+
+private:
+    struct Flags
+    {
+        bool ssse3;
+        bool sse41;
+        bool sse42;
+        bool popcnt;
+        bool pclmul;
+        bool aesni;
+        bool avx2;
+    };
+
+    static const Flags &Get()
+    {
+        static const Flags flags = Detect();
+        return flags;
+    }
+
+    static Flags Detect()
+    {
+        Flags flags = { false, false, false, false, false, false, false };
+#if defined(CPU_FEATURES_X86)
+        unsigned int regs[4] = { 0, 0, 0, 0 };
+        CpuId(0, 0, regs);
+        unsigned int max_leaf = regs[0];
+        if (max_leaf < 1) {
+            return flags;
+        }
+        CpuId(1, 0, regs);
+        unsigned int ecx = regs[2];
+        flags.ssse3 = (ecx & (1u << 9)) != 0;
+        flags.sse41 = (ecx & (1u << 19)) != 0;
+        flags.sse42 = (ecx & (1u << 20)) != 0;
+        flags.popcnt = (ecx & (1u << 23)) != 0;
+        flags.pclmul = (ecx & (1u << 1)) != 0;
+        flags.aesni = (ecx & (1u << 25)) != 0;
+        bool osxsave = (ecx & (1u << 27)) != 0;
+        bool avx = (ecx & (1u << 28)) != 0;
+        if (max_leaf >= 7 && osxsave && avx && (XGetBv() & 6) == 6) {
+            CpuId(7, 0, regs);
+            flags.avx2 = (regs[1] & (1u << 5)) != 0;
+        }
+#endif
+        return flags;
+    }
+
+#if defined(CPU_FEATURES_X86)
+    static void CpuId(unsigned int leaf, unsigned int sub, unsigned int regs[4])
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuidex(info, (int)leaf, (int)sub);
+        for (int i = 0; i < 4; i++) {
+            regs[i] = (unsigned int)info[i];
+        }
+#else
+        __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    //the register state the os saves on a context switch, only called with osxsave set
+    static unsigned long long XGetBv()
+    {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return ((unsigned long long)edx << 32) | eax;
+#endif
+    }
+#endif
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef CRC_H_INCLUDED
+#define CRC_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#if defined(_MSC_VER)
+#include <template\table.h>
+#include <algorithm\CpuFeatures.h>
+#elif defined(__GNUC__)
+#include <template/table.h>
+#include <algorithm/CpuFeatures.h>
+#else
+#error unsupported compiler
+#endif
+#if defined(CPU_FEATURES_X86)
+#include <immintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define CRC_BIG_ENDIAN
+#endif
+
+class Crc
+{
+    /**
+    *CRC32 (zlib, ethernet) and CRC32C (Castagnoli, iSCSI, SCTP) of byte
+    *buffers, both the usual reflected form with the inversions done here, so
+    *a crc of 0 starts a new one and the result of one call feeds the next.
+    *the kernel is picked once from the cpu: PCLMULQDQ folding for CRC32 and
+    *the SSE4.2 crc32 instruction for CRC32C, slicing by 16 tables elsewhere.
+    *the tables are built by the compiler, nothing is initialized at runtime
+    */
+public:
+    static const uint32_t CRC32Poly = 0xEDB88320;
+    static const uint32_t CRC32CPoly = 0x82F63B78;
+
+    /**
+    *continue the CRC32 crc with len bytes of buf
+    */
+    static uint32_t CRC32(uint32_t crc, const void *buf, size_t len)
+    {
+#if defined(CPU_FEATURES_X86)
+        static const Kernel kernel = CpuFeatures::HasPCLMUL() && CpuFeatures::HasSSE41() ? &CRC32Fold : &Slice16<CRC32Poly>;
+#else
+        static const Kernel kernel = &Slice16<CRC32Poly>;
+#endif
+        return ~kernel(~crc, static_cast<const unsigned char*>(buf), len);
+    }
+
+    /**
+    *continue the CRC32C crc with len bytes of buf
+    */
+    static uint32_t CRC32C(uint32_t crc, const void *buf, size_t len)
+    {
+#if defined(CPU_FEATURES_X86)
+        static const Kernel kernel = CpuFeatures::HasSSE42() ? &CRC32CInstruction : &Slice16<CRC32CPoly>;
+#else
+        static const Kernel kernel = &Slice16<CRC32CPoly>;
+#endif
+        return ~kernel(~crc, static_cast<const unsigned char*>(buf), len);
+    }
+
+    /**
+    *the CRC32 of two chunks one after the other, from the CRC32 crc1 of the
+    *first, crc2 of the second and the length of the second. chunks can so be
+    *summed on several threads
+    */
+    static uint32_t CRC32Combine(uint32_t crc1, uint32_t crc2, unsigned long long len2)
+    {
+        return Combine<CRC32Poly>(crc1, crc2, len2);
+    }
+
+    /**
+    *the same for CRC32C
+    */
+    static uint32_t CRC32CCombine(uint32_t crc1, uint32_t crc2, unsigned long long len2)
+    {
+        return Combine<CRC32CPoly>(crc1, crc2, len2);
+    }
+
+    /**
+    *the kernels by name, for tests and benchmarks. they take and return the
+    *raw register, without the inversions. the hardware ones only when the
+    *matching Has function of CpuFeatures is true
+    */
+    typedef uint32_t(*Kernel)(uint32_t crc, const unsigned char *buf, size_t len);
+
+    template <uint32_t Poly>
+    static uint32_t Bytewise(uint32_t crc, const unsigned char *buf, size_t len)
+    {
+        const stdex::table<uint32_t, 256> &t0 = Table<Poly, 0>();
+        while (len--) {
+            crc = t0[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+        }
+        return crc;
+    }
+
+    template <uint32_t Poly>
+    static uint32_t Slice8(uint32_t crc, const unsigned char *buf, size_t len)
+    {
+#if !defined(CRC_BIG_ENDIAN)
+        const stdex::table<uint32_t, 256> &t0 = Table<Poly, 0>(), &t1 = Table<Poly, 1>(), &t2 = Table<Poly, 2>(), &t3 = Table<Poly, 3>();
+        const stdex::table<uint32_t, 256> &t4 = Table<Poly, 4>(), &t5 = Table<Poly, 5>(), &t6 = Table<Poly, 6>(), &t7 = Table<Poly, 7>();
+        for (; len >= 8; buf += 8, len -= 8) {
+            uint32_t one = Load32(buf) ^ crc;
+            uint32_t two = Load32(buf + 4);
+            crc = t7[one & 0xff] ^ t6[(one >> 8) & 0xff] ^ t5[(one >> 16) & 0xff] ^ t4[one >> 24] ^
+                t3[two & 0xff] ^ t2[(two >> 8) & 0xff] ^ t1[(two >> 16) & 0xff] ^ t0[two >> 24];
+        }
+#endif
+        return Bytewise<Poly>(crc, buf, len);
+    }
+
+    template <uint32_t Poly>
+    static uint32_t Slice16(uint32_t crc, const unsigned char *buf, size_t len)
+    {
+#if !defined(CRC_BIG_ENDIAN)
+        const stdex::table<uint32_t, 256> &t0 = Table<Poly, 0>(), &t1 = Table<Poly, 1>(), &t2 = Table<Poly, 2>(), &t3 = Table<Poly, 3>();
+        const stdex::table<uint32_t, 256> &t4 = Table<Poly, 4>(), &t5 = Table<Poly, 5>(), &t6 = Table<Poly, 6>(), &t7 = Table<Poly, 7>();
+        const stdex::table<uint32_t, 256> &t8 = Table<Poly, 8>(), &t9 = Table<Poly, 9>(), &t10 = Table<Poly, 10>(), &t11 = Table<Poly, 11>();
+        const stdex::table<uint32_t, 256> &t12 = Table<Poly, 12>(), &t13 = Table<Poly, 13>(), &t14 = Table<Poly, 14>(), &t15 = Table<Poly, 15>();
+        for (; len >= 16; buf += 16, len -= 16) {
+            uint32_t one = Load32(buf) ^ crc;
+            uint32_t two = Load32(buf + 4);
+            uint32_t three = Load32(buf + 8);
+            uint32_t four = Load32(buf + 12);
+            crc = t15[one & 0xff] ^ t14[(one >> 8) & 0xff] ^ t13[(one >> 16) & 0xff] ^ t12[one >> 24] ^
+                t11[two & 0xff] ^ t10[(two >> 8) & 0xff] ^ t9[(two >> 16) & 0xff] ^ t8[two >> 24] ^
+                t7[three & 0xff] ^ t6[(three >> 8) & 0xff] ^ t5[(three >> 16) & 0xff] ^ t4[three >> 24] ^
+                t3[four & 0xff] ^ t2[(four >> 8) & 0xff] ^ t1[(four >> 16) & 0xff] ^ t0[four >> 24];
+        }
+#endif
+        return Slice8<Poly>(crc, buf, len);
+    }
+
+#if defined(CPU_FEATURES_X86)
+    /**
+    *CRC32C with the SSE4.2 crc32 instruction, 8 bytes a step on x64
+    */
+    CPU_TARGET("sse4.2")
+    static uint32_t CRC32CInstruction(uint32_t crc, const unsigned char *buf, size_t len)
+    {
+#if defined(_M_X64) || defined(__x86_64__)
+        unsigned long long crc64 = crc;
+        for (; len >= 8; buf += 8, len -= 8) {
+            unsigned long long value;
+            memcpy(&value, buf, sizeof(value));
+            crc64 = _mm_crc32_u64(crc64, value);
+        }
+        crc = (uint32_t)crc64;
+#else
+        for (; len >= 4; buf += 4, len -= 4) {
+            crc = _mm_crc32_u32(crc, Load32(buf));
+        }
+#endif
+        while (len--) {
+            crc = _mm_crc32_u8(crc, *buf++);
+        }
+        return crc;
+    }
+
+    /**
+    *CRC32 by folding 64 byte blocks with carry-less multiplies, then a Barrett
+    *reduction, as in Intel's "Fast CRC Computation for Generic Polynomials
+    *Using PCLMULQDQ". buffers below 64 bytes and the tail go to Slice16
+    */
+    CPU_TARGET("pclmul,sse4.1")
+    static uint32_t CRC32Fold(uint32_t crc, const unsigned char *buf, size_t len)
+    {
+        if (len < 64) {
+            return Slice16<CRC32Poly>(crc, buf, len);
+        }
+        //x^(4*128+64) and x^(4*128) mod P, then the same for one block, x^64 and the Barrett constants
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+        const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+        const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+        const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+        __m128i x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+        __m128i x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+        __m128i x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+        buf += 64;
+        len -= 64;
+
+        //four lanes of 128 bits, each folded 512 bits forward
+        for (; len >= 64; buf += 64, len -= 64) {
+            x1 = Fold(x1, k1k2, _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+            x2 = Fold(x2, k1k2, _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+            x3 = Fold(x3, k1k2, _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+            x4 = Fold(x4, k1k2, _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+        }
+
+        //the lanes into one, then whole 16 byte blocks
+        x1 = Fold(x1, k3k4, x2);
+        x1 = Fold(x1, k3k4, x3);
+        x1 = Fold(x1, k3k4, x4);
+        for (; len >= 16; buf += 16, len -= 16) {
+            x1 = Fold(x1, k3k4, _mm_loadu_si128((const __m128i*)buf));
+        }
+
+        //128 bits to 64
+        x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, mask);
+        x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        //Barrett reduction to 32 bits
+        x2 = _mm_and_si128(x1, mask);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+        x2 = _mm_and_si128(x2, mask);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+        crc = (uint32_t)_mm_extract_epi32(x1, 1);
+
+        return Slice16<CRC32Poly>(crc, buf, len);
+    }
+#endif
+
+private:
+    template <uint32_t Poly, size_t K>
+    static const stdex::table<uint32_t, 256> &Table()
+    {
+        return stdex::static_table<uint32_t, 256, stdex::crc32_slice_gen<Poly, K>>::value;
+    }
+
+    static uint32_t Load32(const unsigned char *buf)
+    {
+        uint32_t value;
+        memcpy(&value, buf, sizeof(value));
+        return value;
+    }
+
+#if defined(CPU_FEATURES_X86)
+    CPU_TARGET("pclmul,sse4.1")
+    static __m128i Fold(__m128i x, __m128i k, __m128i data)
+    {
+        __m128i low = _mm_clmulepi64_si128(x, k, 0x00);
+        __m128i high = _mm_clmulepi64_si128(x, k, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(high, low), data);
+    }
+#endif
+
+    //crc1 moved past len2 zero bytes is crc1 * x^(8 * len2) mod Poly, then add crc2
+    template <uint32_t Poly>
+    static uint32_t Combine(uint32_t crc1, uint32_t crc2, unsigned long long len2)
+    {
+        typedef stdex::crc32_x2n_gen<Poly> gf;
+        const stdex::table<uint32_t, 32> &x2n = stdex::static_table<uint32_t, 32, gf>::value;
+        uint32_t shift = 0x80000000u; //x^0
+        for (size_t k = 3; len2; len2 >>= 1, k++) {
+            if (len2 & 1) {
+                shift = gf::mul(x2n[k & 31], shift);
+            }
+        }
+        return gf::mul(shift, crc1) ^ crc2;
+    }
+};
+
+#endif
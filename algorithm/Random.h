@@ -0,0 +1,502 @@
+#ifndef RANDOM_H_INCLUDED
+#define RANDOM_H_INCLUDED
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#if defined(_MSC_VER)
+#include <windows.h>
+#include <wincrypt.h>
+#include <process.h>
+#elif defined(__GNUC__)
+#include <unistd.h>
+#include <fcntl.h>
+#else
+#error unsupported compiler
+#endif
+
+class Xoshiro256;
+class ChaCha20Random;
+
+class Random
+{
+    /**
+    *seeds and the generators every thread keeps for itself. Fast() is the
+    *xoshiro256** of the calling thread, for sequence numbers, ip ids, ports
+    *and the like. Secure() is its ChaCha20 generator, for key material and
+    *anything an attacker should not guess. neither takes a lock
+    */
+public:
+    /**
+    *fill buf with len bytes of seed from the os, /dev/urandom or CryptGenRandom,
+    *mixed with the time, the process and the thread in case it fails
+    */
+    static void Entropy(void *buf, size_t len)
+    {
+        unsigned char *out = static_cast<unsigned char*>(buf);
+        size_t got = 0;
+#if defined(_MSC_VER)
+        HCRYPTPROV hcrypt = 0;
+        if (CryptAcquireContext(&hcrypt, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT)) {
+            if (CryptGenRandom(hcrypt, (DWORD)len, out)) {
+                got = len;
+            }
+            CryptReleaseContext(hcrypt, 0);
+        }
+        uint64_t pid = (uint64_t)_getpid();
+#elif defined(__GNUC__)
+        int fd;
+        if ((fd = open("/dev/urandom", O_RDONLY)) != -1 ||
+            (fd = open("/dev/arandom", O_RDONLY)) != -1) {
+            while (got < len) {
+                ssize_t n = read(fd, out + got, len - got);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                got += (size_t)n;
+            }
+            close(fd);
+        }
+        uint64_t pid = (uint64_t)getpid();
+#else
+#error unsupported compiler
+#endif
+        /* whatever the os gave us, stir in what differs between calls anyway */
+        static std::atomic<uint64_t> calls(0);
+        uint64_t mix = (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+        mix ^= pid << 32;
+        mix ^= (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id()) * 0x9E3779B97F4A7C15ull;
+        mix ^= calls.fetch_add(1, std::memory_order_relaxed) * 0xD1B54A32D192ED03ull;
+        uint64_t word = 0;
+        for (size_t i = 0; i < len; ++i) {
+            if (i % 8 == 0) {
+                word = SplitMix64(mix);
+            }
+            unsigned char byte = (unsigned char)(word >> (i % 8 * 8));
+            out[i] = i < got ? out[i] ^ byte : byte;
+        }
+    }
+
+    /**
+    *the next value of a splitmix64 sequence, state is advanced in place.
+    *spreads one 64 bit seed over the larger state of the other generators
+    */
+    static uint64_t SplitMix64(uint64_t &state)
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    /**
+    *the fast generator of the calling thread
+    */
+    static Xoshiro256 &Fast();
+
+    /**
+    *the cryptographically secure generator of the calling thread
+    */
+    static ChaCha20Random &Secure();
+};
+
+class Xoshiro256
+{
+    /**
+    *xoshiro256** by Blackman and Vigna: 256 bits of state, period 2^256 - 1,
+    *a few cycles a number. not for secrets, the state follows from the output.
+    *meets UniformRandomBitGenerator, so <random> distributions take it
+    */
+public:
+    typedef uint64_t result_type;
+
+    /**
+    *seeded from the os
+    */
+    Xoshiro256()
+    {
+        do {
+            Random::Entropy(s, sizeof(s));
+        } while ((s[0] | s[1] | s[2] | s[3]) == 0);
+    }
+
+    /**
+    *the same seed gives the same sequence
+    */
+    explicit Xoshiro256(uint64_t seed)
+    {
+        for (int i = 0; i < 4; ++i) {
+            s[i] = Random::SplitMix64(seed);
+        }
+    }
+
+    uint64_t Next()
+    {
+        uint64_t result = Rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = Rotl(s[3], 45);
+        return result;
+    }
+
+    /**
+    *fill buf with len random bytes, eight at a time
+    */
+    void Fill(void *buf, size_t len)
+    {
+        unsigned char *out = static_cast<unsigned char*>(buf);
+        for (; len >= 8; out += 8, len -= 8) {
+            uint64_t value = Next();
+            memcpy(out, &value, 8);
+        }
+        if (len) {
+            uint64_t value = Next();
+            memcpy(out, &value, len);
+        }
+    }
+
+    /**
+    *advance 2^128 numbers, giving a stream that will not overlap this one,
+    *for handing one seed out to many threads
+    */
+    void Jump()
+    {
+        static const uint64_t jump[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+        uint64_t t[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4; ++i) {
+            for (int b = 0; b < 64; ++b) {
+                if (jump[i] & (1ull << b)) {
+                    t[0] ^= s[0];
+                    t[1] ^= s[1];
+                    t[2] ^= s[2];
+                    t[3] ^= s[3];
+                }
+                Next();
+            }
+        }
+        memcpy(s, t, sizeof(s));
+    }
+
+    result_type operator()() { return Next(); }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xFFFFFFFFFFFFFFFFull; }
+
+private:
+    static uint64_t Rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t s[4];
+};
+
+class Pcg32
+{
+    /**
+    *PCG32 (XSH RR) by O'Neill: 64 bits of state, 32 bit output, and 2^63
+    *independent streams picked by the second seed. smaller than xoshiro when
+    *many generators are kept, one per target for example
+    */
+public:
+    typedef uint32_t result_type;
+
+    explicit Pcg32(uint64_t seed, uint64_t stream = 0x14057B7EF767814Full) : state(0), inc((stream << 1) | 1)
+    {
+        Next();
+        state += seed;
+        Next();
+    }
+
+    uint32_t Next()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + inc;
+        uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        uint32_t rot = (uint32_t)(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    /**
+    *fill buf with len random bytes, four at a time
+    */
+    void Fill(void *buf, size_t len)
+    {
+        unsigned char *out = static_cast<unsigned char*>(buf);
+        for (; len >= 4; out += 4, len -= 4) {
+            uint32_t value = Next();
+            memcpy(out, &value, 4);
+        }
+        if (len) {
+            uint32_t value = Next();
+            memcpy(out, &value, len);
+        }
+    }
+
+    result_type operator()() { return Next(); }
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xFFFFFFFFu; }
+
+private:
+    uint64_t state;
+    uint64_t inc;
+};
+
+class ChaCha20Random
+{
+    /**
+    *a ChaCha20 keystream used as a generator, as arc4random does: four blocks
+    *are made at a time, the first 32 bytes become the next key and the rest
+    *is handed out. bytes are wiped once given, so a later look at the memory
+    *tells nothing about what came out before (fast key erasure)
+    */
+public:
+    /**
+    *keyed from the os
+    */
+    ChaCha20Random() : avail(0)
+    {
+        Random::Entropy(key, sizeof(key));
+    }
+
+    /**
+    *the same key gives the same stream, for tests
+    */
+    explicit ChaCha20Random(const uint32_t seed_key[8]) : avail(0)
+    {
+        memcpy(key, seed_key, sizeof(key));
+    }
+
+    ~ChaCha20Random()
+    {
+        Wipe(key, sizeof(key));
+        Wipe(buffer, sizeof(buffer));
+    }
+
+    ChaCha20Random(const ChaCha20Random&) = delete;
+    ChaCha20Random &operator=(const ChaCha20Random&) = delete;
+
+    void Fill(void *buf, size_t len)
+    {
+        unsigned char *out = static_cast<unsigned char*>(buf);
+        while (len) {
+            if (avail == 0) {
+                Refill();
+            }
+            size_t n = len < avail ? len : avail;
+            unsigned char *from = buffer + sizeof(buffer) - avail;
+            memcpy(out, from, n);
+            Wipe(from, n);
+            out += n;
+            len -= n;
+            avail -= n;
+        }
+    }
+
+    uint64_t Next()
+    {
+        uint64_t value;
+        Fill(&value, sizeof(value));
+        return value;
+    }
+
+    /**
+    *mix fresh os entropy into the key
+    */
+    void Reseed()
+    {
+        uint32_t fresh[8];
+        Random::Entropy(fresh, sizeof(fresh));
+        for (int i = 0; i < 8; ++i) {
+            key[i] ^= fresh[i];
+        }
+        Wipe(fresh, sizeof(fresh));
+        avail = 0;
+    }
+
+    /**
+    *the ChaCha20 block function: 20 rounds over the 16 word input, added back
+    *to it (RFC 7539 2.3)
+    */
+    static void Block(const uint32_t input[16], uint32_t output[16])
+    {
+        uint32_t x[16];
+        memcpy(x, input, sizeof(x));
+        for (int i = 0; i < 10; ++i) {
+            QuarterRound(x[0], x[4], x[8], x[12]);
+            QuarterRound(x[1], x[5], x[9], x[13]);
+            QuarterRound(x[2], x[6], x[10], x[14]);
+            QuarterRound(x[3], x[7], x[11], x[15]);
+            QuarterRound(x[0], x[5], x[10], x[15]);
+            QuarterRound(x[1], x[6], x[11], x[12]);
+            QuarterRound(x[2], x[7], x[8], x[13]);
+            QuarterRound(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; ++i) {
+            output[i] = x[i] + input[i];
+        }
+    }
+
+private:
+    static const size_t Blocks = 4;
+
+    void Refill()
+    {
+        uint32_t input[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+        memcpy(input + 4, key, sizeof(key));
+        uint32_t output[16];
+        for (size_t b = 0; b < Blocks; ++b) {
+            //counter in word 12, a new key each refill so it starts at 0
+            input[12] = (uint32_t)b;
+            Block(input, output);
+            for (int i = 0; i < 16; ++i) {
+                //little endian bytes, the same stream on every host
+                unsigned char *p = buffer + b * 64 + i * 4;
+                p[0] = (unsigned char)output[i];
+                p[1] = (unsigned char)(output[i] >> 8);
+                p[2] = (unsigned char)(output[i] >> 16);
+                p[3] = (unsigned char)(output[i] >> 24);
+            }
+        }
+        memcpy(key, buffer, sizeof(key));
+        Wipe(buffer, sizeof(key));
+        Wipe(input, sizeof(input));
+        Wipe(output, sizeof(output));
+        avail = sizeof(buffer) - sizeof(key);
+    }
+
+    static void QuarterRound(uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d)
+    {
+        a += b; d ^= a; d = (d << 16) | (d >> 16);
+        c += d; b ^= c; b = (b << 12) | (b >> 20);
+        a += b; d ^= a; d = (d << 8) | (d >> 24);
+        c += d; b ^= c; b = (b << 7) | (b >> 25);
+    }
+
+    //through a volatile pointer so the compiler keeps it
+    static void Wipe(void *buf, size_t len)
+    {
+        volatile unsigned char *p = static_cast<volatile unsigned char*>(buf);
+        while (len--) {
+            *p++ = 0;
+        }
+    }
+
+    uint32_t key[8];
+    unsigned char buffer[Blocks * 64];
+    size_t avail;
+};
+
+class UniqueRandomU32
+{
+    /**
+    *random looking 32 bit numbers that never repeat until all 2^32 were given,
+    *for ip ids or probe tags of one scan. each scan keeps its own, seeded at
+    *construction. Next() is safe from any thread: the i-th call takes index i
+    *with one atomic add, jumps the LCG to its i-th state in at most 32 steps
+    *and returns a fixed permutation of that state
+    */
+public:
+    /**
+    *seeded from the os
+    */
+    UniqueRandomU32() : index(0)
+    {
+        uint32_t seed[4];
+        Random::Entropy(seed, sizeof(seed));
+        Init(seed[0], seed[1], seed[2], seed[3]);
+    }
+
+    /**
+    *the same seed gives the same sequence
+    */
+    explicit UniqueRandomU32(uint64_t seed) : index(0)
+    {
+        uint64_t one = Random::SplitMix64(seed);
+        uint64_t two = Random::SplitMix64(seed);
+        Init((uint32_t)one, (uint32_t)(one >> 32), (uint32_t)two, (uint32_t)(two >> 32));
+    }
+
+    uint32_t Next()
+    {
+        return Permute(Advance(start, index.fetch_add(1, std::memory_order_relaxed) + 1));
+    }
+
+    /**
+    *the LCG from Numerical Recipes (m=2^32, a=1664525, c=1013904223), its
+    *period is exactly 2^32. steps calls of it in one go: f^(2^k) is squared
+    *from f^(2^(k-1)), so it takes one round per bit of steps
+    */
+    static uint32_t Advance(uint32_t state, uint32_t steps)
+    {
+        uint32_t mul = 1664525u;
+        uint32_t add = 1013904223u;
+        for (; steps; steps >>= 1) {
+            if (steps & 1) {
+                state = state * mul + add;
+            }
+            add = (mul + 1) * add;
+            mul *= mul;
+        }
+        return state;
+    }
+
+    /**
+    *the permutation of an LCG state, as the older GetRandomUniqueU32 ran it:
+    *a rotation and a round key xor, then two rounds of an affine transform in
+    *GF(2^32) with an odd multiplier (glibc and Quick C constants), a rotation
+    *and a round key xor. each step is a bijection, so distinct states give
+    *distinct outputs. it hides the linear walk of the LCG, not a counter
+    */
+    uint32_t Permute(uint32_t value) const
+    {
+        value = (value << 7) | (value >> (32 - 7));
+        value ^= tweak1;
+        value = value * 1103515245u + 12345u;
+        value = (value << 15) | (value >> (32 - 15));
+        value ^= tweak2;
+        value = value * 214013u + 2531011u;
+        value = (value << 5) | (value >> (32 - 5));
+        return value ^ tweak3;
+    }
+
+private:
+    void Init(uint32_t seed_start, uint32_t seed1, uint32_t seed2, uint32_t seed3)
+    {
+        start = seed_start;
+        tweak1 = seed1;
+        tweak2 = seed2;
+        tweak3 = seed3;
+    }
+
+    std::atomic<uint32_t> index;
+    uint32_t start;
+    uint32_t tweak1;
+    uint32_t tweak2;
+    uint32_t tweak3;
+};
+
+inline Xoshiro256 &Random::Fast()
+{
+    static thread_local Xoshiro256 generator;
+    return generator;
+}
+
+inline ChaCha20Random &Random::Secure()
+{
+    static thread_local ChaCha20Random generator;
+    return generator;
+}
+
+#endif
@@ -0,0 +1,197 @@
+#if defined(_MSC_VER)
+#include <algorithm\Crc.h>
+#include <algorithm\Checksum.h>
+#include <algorithm\Random.h>
+#include <algorithm\BitOps.h>
+#include <algorithm\encrypt\AES.h>
+#elif defined(__GNUC__)
+#include <algorithm/Crc.h>
+#include <algorithm/Checksum.h>
+#include <algorithm/Random.h>
+#include <algorithm/BitOps.h>
+#include <algorithm/encrypt/AES.h>
+#else
+#error unsupported compiler
+#endif
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <functional>
+
+static std::vector<unsigned char> MakeBuffer(size_t size)
+{
+    std::vector<unsigned char> buf(size);
+    unsigned int seed = 1;
+    for (auto &c : buf) {
+        seed = seed * 1103515245 + 12345;
+        c = (unsigned char)(seed >> 16);
+    }
+    return buf;
+}
+
+//GB/s of f over the buffer, repeated until a quarter second has gone
+static double Throughput(const std::vector<unsigned char> &buf, const std::function<uint32_t(const unsigned char*, size_t)> &f)
+{
+    volatile uint32_t sink = 0;
+    size_t rounds = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> used(0);
+    while (used.count() < 0.25) {
+        sink = sink + f(buf.data(), buf.size());
+        ++rounds;
+        used = std::chrono::steady_clock::now() - start;
+    }
+    return rounds * buf.size() / used.count() / 1e9;
+}
+
+static void Report(const std::string &name, double gbps)
+{
+    std::cout << std::left << std::setw(28) << name << std::fixed << std::setprecision(2) << gbps << " GB/s" << std::endl;
+}
+
+//cycles per byte of f over len bytes, from the time stamp counter, the best of a few runs
+static double CyclesPerByte(size_t len, const std::function<void()> &f)
+{
+    double best = 0;
+    for (int run = 0; run < 5; ++run) {
+#if defined(CPU_FEATURES_X86)
+        unsigned long long start = __rdtsc();
+        f();
+        double cycles = (double)(__rdtsc() - start);
+#else
+        //no counter to read, nanoseconds stand in for cycles
+        auto start = std::chrono::steady_clock::now();
+        f();
+        double cycles = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+#endif
+        if (run == 0 || cycles < best) {
+            best = cycles;
+        }
+    }
+    return best / len;
+}
+
+//AES-128 in each block mode with the selected backend
+static void ReportAES(const std::string &backend, std::vector<unsigned char> &out, const std::vector<unsigned char> &buf)
+{
+    unsigned char user_key[16] = { 0 };
+    AES_KEY encrypt_key, decrypt_key;
+    AES::SetEncryptKey(user_key, 128, &encrypt_key);
+    AES::SetDecryptKey(user_key, 128, &decrypt_key);
+    size_t len = buf.size();
+    std::cout << "aes-128 " << backend << std::endl;
+    std::cout << std::left << std::setw(28) << "  ecb encrypt" << std::fixed << std::setprecision(2) << CyclesPerByte(len, [&] {
+        for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+            AES::EncryptBlock(&buf[i], &out[i], &encrypt_key);
+        }
+    }) << " cycles/byte" << std::endl;
+    std::cout << std::left << std::setw(28) << "  ecb decrypt" << CyclesPerByte(len, [&] {
+        for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+            AES::DecryptBlock(&buf[i], &out[i], &decrypt_key);
+        }
+    }) << " cycles/byte" << std::endl;
+    std::cout << std::left << std::setw(28) << "  cbc encrypt" << CyclesPerByte(len, [&] {
+        unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+        AES_CBC::CBC128EncryptBlock(buf.data(), out.data(), len, &encrypt_key, iv, AES_ENCRYPT);
+    }) << " cycles/byte" << std::endl;
+    std::cout << std::left << std::setw(28) << "  cbc decrypt" << CyclesPerByte(len, [&] {
+        unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+        AES_CBC::CBC128EncryptBlock(buf.data(), out.data(), len, &decrypt_key, iv, AES_DECRYPT);
+    }) << " cycles/byte" << std::endl;
+    std::cout << std::left << std::setw(28) << "  ctr" << CyclesPerByte(len, [&] {
+        unsigned char iv[AES_BLOCK_SIZE] = { 0 };
+        unsigned char ecount[AES_BLOCK_SIZE] = { 0 };
+        unsigned int num = 0;
+        AES_CTR::Ctr128Encrypt(buf.data(), out.data(), len, &encrypt_key, iv, ecount, &num);
+    }) << " cycles/byte" << std::endl;
+}
+
+//CRC32 of the buffer in one chunk per thread, joined with CRC32Combine
+static uint32_t ParallelCRC32(const unsigned char *buf, size_t len, size_t threads)
+{
+    std::vector<uint32_t> crcs(threads);
+    std::vector<std::thread> workers;
+    size_t chunk = len / threads;
+    for (size_t t = 0; t < threads; ++t) {
+        size_t size = t + 1 == threads ? len - chunk * t : chunk;
+        workers.emplace_back([&crcs, buf, chunk, size, t] { crcs[t] = Crc::CRC32(0, buf + chunk * t, size); });
+    }
+    uint32_t crc = 0;
+    for (size_t t = 0; t < threads; ++t) {
+        workers[t].join();
+        size_t size = t + 1 == threads ? len - chunk * t : chunk;
+        crc = Crc::CRC32Combine(crc, crcs[t], size);
+    }
+    return crc;
+}
+
+int main()
+{
+    std::vector<unsigned char> buf = MakeBuffer(4 << 20);
+    std::cout << "crc over " << (buf.size() >> 20) << " MB, pclmul " << CpuFeatures::HasPCLMUL() << " sse4.2 " << CpuFeatures::HasSSE42() << std::endl;
+
+    Report("crc32 bytewise", Throughput(buf, [](const unsigned char *p, size_t n) { return Crc::Bytewise<Crc::CRC32Poly>(~0u, p, n); }));
+    Report("crc32 slice by 8", Throughput(buf, [](const unsigned char *p, size_t n) { return Crc::Slice8<Crc::CRC32Poly>(~0u, p, n); }));
+    Report("crc32 slice by 16", Throughput(buf, [](const unsigned char *p, size_t n) { return Crc::Slice16<Crc::CRC32Poly>(~0u, p, n); }));
+#if defined(CPU_FEATURES_X86)
+    if (CpuFeatures::HasPCLMUL() && CpuFeatures::HasSSE41()) {
+        Report("crc32 pclmul", Throughput(buf, [](const unsigned char *p, size_t n) { return Crc::CRC32Fold(~0u, p, n); }));
+    }
+    if (CpuFeatures::HasSSE42()) {
+        Report("crc32c sse4.2", Throughput(buf, [](const unsigned char *p, size_t n) { return Crc::CRC32CInstruction(~0u, p, n); }));
+    }
+#endif
+    Report("crc32c slice by 16", Throughput(buf, [](const unsigned char *p, size_t n) { return Crc::Slice16<Crc::CRC32CPoly>(~0u, p, n); }));
+
+    size_t cores = std::thread::hardware_concurrency();
+    if (!cores) cores = 4;
+    Report("crc32 " + std::to_string(cores) + " threads + combine", Throughput(buf, [cores](const unsigned char *p, size_t n) { return ParallelCRC32(p, n, cores); }));
+
+    std::cout << "internet checksum, avx2 " << CpuFeatures::HasAVX2() << std::endl;
+    Report("checksum scalar", Throughput(buf, [](const unsigned char *p, size_t n) { return (uint32_t)Checksum::Fold(Checksum::AddScalar(p, n, 0)); }));
+#if defined(CPU_FEATURES_X86)
+    if (CpuFeatures::HasAVX2()) {
+        Report("checksum avx2", Throughput(buf, [](const unsigned char *p, size_t n) { return (uint32_t)Checksum::Fold(Checksum::AddAVX2(p, n, 0)); }));
+    }
+#endif
+
+    //the buffer is only there for its size, the generators write into out
+    std::vector<unsigned char> out(buf.size());
+    std::cout << "random bytes" << std::endl;
+    Report("xoshiro256** fill", Throughput(buf, [&out](const unsigned char*, size_t n) { Random::Fast().Fill(out.data(), n); return (uint32_t)out[0]; }));
+    Pcg32 pcg(1);
+    Report("pcg32 fill", Throughput(buf, [&out, &pcg](const unsigned char*, size_t n) { pcg.Fill(out.data(), n); return (uint32_t)out[0]; }));
+    Report("chacha20 fill", Throughput(buf, [&out](const unsigned char*, size_t n) { Random::Secure().Fill(out.data(), n); return (uint32_t)out[0]; }));
+
+    std::cout << "bit count and reverse, popcnt " << CpuFeatures::HasPOPCNT() << " ssse3 " << CpuFeatures::HasSSSE3() << std::endl;
+    Report("bit count scalar", Throughput(buf, [](const unsigned char *p, size_t n) { return (uint32_t)BitOps::CountScalar(p, n); }));
+    Report("bit reverse scalar", Throughput(buf, [&out](const unsigned char *p, size_t n) { BitOps::ReverseScalar(out.data(), p, n, 4); return (uint32_t)out[0]; }));
+#if defined(CPU_FEATURES_X86)
+    if (CpuFeatures::HasPOPCNT()) {
+        Report("bit count popcnt", Throughput(buf, [](const unsigned char *p, size_t n) { return (uint32_t)BitOps::CountPOPCNT(p, n); }));
+    }
+    if (CpuFeatures::HasAVX2()) {
+        Report("bit count avx2 harley-seal", Throughput(buf, [](const unsigned char *p, size_t n) { return (uint32_t)BitOps::CountAVX2(p, n); }));
+    }
+    if (CpuFeatures::HasSSSE3()) {
+        Report("bit reverse ssse3", Throughput(buf, [&out](const unsigned char *p, size_t n) { BitOps::ReverseSSSE3(out.data(), p, n, 4); return (uint32_t)out[0]; }));
+    }
+    if (CpuFeatures::HasAVX2()) {
+        Report("bit reverse avx2", Throughput(buf, [&out](const unsigned char *p, size_t n) { BitOps::ReverseAVX2(out.data(), p, n, 4); return (uint32_t)out[0]; }));
+    }
+#endif
+
+    //a megabyte is enough for a steady figure with the slow backends
+    std::vector<unsigned char> block_buf(buf.begin(), buf.begin() + (1 << 20));
+    if (AES::SetBackend(AES_BACKEND_AESNI)) {
+        ReportAES("aes-ni", out, block_buf);
+    }
+    AES::SetBackend(AES_BACKEND_TABLE);
+    ReportAES("tables", out, block_buf);
+    AES::SetBackend(AES_BACKEND_CONSTANT_TIME);
+    ReportAES("constant time", out, block_buf);
+    return 0;
+}
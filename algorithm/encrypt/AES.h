@@ -5,13 +5,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <atomic>
 #if defined(_MSC_VER)
 #include <algorithm\AlgorithmHelper.h>
+#include <algorithm\CpuFeatures.h>
 #elif defined(__GNUC__)
 #include <algorithm/AlgorithmHelper.h>
+#include <algorithm/CpuFeatures.h>
 #else
 #error unsupported compiler
 #endif
+#if defined(CPU_FEATURES_X86)
+#include <immintrin.h>
+#endif
 
 # if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_AMD64) || defined(_M_X64))
 #  define AES_SWAP(x) (_lrotl(x, 8) & 0x00ff00ff | _lrotr(x, 8) & 0xff00ff00)
@@ -40,6 +46,19 @@ typedef struct aes_key_st {
     int rounds;
 }AES_KEY;
 
+/*
+* How a block is run through the cipher, the key schedule is the same for all.
+* AES_BACKEND_AESNI: the aesenc/aesdec instructions, constant time.
+* AES_BACKEND_TABLE: the Te/Td lookup tables, fast but the cache lines touched depend on the key and the data, opt in only where timing can not leak.
+* AES_BACKEND_CONSTANT_TIME: bitsliced, all sixteen bytes through a boolean circuit of the S-box, no lookups nor branches on secrets, but slower than the tables.
+*/
+enum aes_backend_type
+{
+    AES_BACKEND_TABLE = 0,
+    AES_BACKEND_CONSTANT_TIME = 1,
+    AES_BACKEND_AESNI = 2
+};
+
 class AES
 {
     /*-
@@ -708,12 +727,7 @@ public:
         if (bits == 128) {
             while (1) {
                 temp = rk[3];
-                rk[4] = rk[0] ^
-                    (Te2()[(temp >> 16) & 0xff] & 0xff000000) ^
-                    (Te3()[(temp >> 8) & 0xff] & 0x00ff0000) ^
-                    (Te0()[(temp) & 0xff] & 0x0000ff00) ^
-                    (Te1()[(temp >> 24)] & 0x000000ff) ^
-                    rcon()[i];
+                rk[4] = rk[0] ^ SubWord((temp << 8) | (temp >> 24)) ^ rcon()[i];
                 rk[5] = rk[1] ^ rk[4];
                 rk[6] = rk[2] ^ rk[5];
                 rk[7] = rk[3] ^ rk[6];
@@ -728,12 +742,7 @@ public:
         if (bits == 192) {
             while (1) {
                 temp = rk[5];
-                rk[6] = rk[0] ^
-                    (Te2()[(temp >> 16) & 0xff] & 0xff000000) ^
-                    (Te3()[(temp >> 8) & 0xff] & 0x00ff0000) ^
-                    (Te0()[(temp) & 0xff] & 0x0000ff00) ^
-                    (Te1()[(temp >> 24)] & 0x000000ff) ^
-                    rcon()[i];
+                rk[6] = rk[0] ^ SubWord((temp << 8) | (temp >> 24)) ^ rcon()[i];
                 rk[7] = rk[1] ^ rk[6];
                 rk[8] = rk[2] ^ rk[7];
                 rk[9] = rk[3] ^ rk[8];
@@ -750,12 +759,7 @@ public:
         if (bits == 256) {
             while (1) {
                 temp = rk[7];
-                rk[8] = rk[0] ^
-                    (Te2()[(temp >> 16) & 0xff] & 0xff000000) ^
-                    (Te3()[(temp >> 8) & 0xff] & 0x00ff0000) ^
-                    (Te0()[(temp) & 0xff] & 0x0000ff00) ^
-                    (Te1()[(temp >> 24)] & 0x000000ff) ^
-                    rcon()[i];
+                rk[8] = rk[0] ^ SubWord((temp << 8) | (temp >> 24)) ^ rcon()[i];
                 rk[9] = rk[1] ^ rk[8];
                 rk[10] = rk[2] ^ rk[9];
                 rk[11] = rk[3] ^ rk[10];
@@ -763,11 +767,7 @@ public:
                     return 0;
                 }
                 temp = rk[11];
-                rk[12] = rk[4] ^
-                    (Te2()[(temp >> 24)] & 0xff000000) ^
-                    (Te3()[(temp >> 16) & 0xff] & 0x00ff0000) ^
-                    (Te0()[(temp >> 8) & 0xff] & 0x0000ff00) ^
-                    (Te1()[(temp) & 0xff] & 0x000000ff);
+                rk[12] = rk[4] ^ SubWord(temp);
                 rk[13] = rk[5] ^ rk[12];
                 rk[14] = rk[6] ^ rk[13];
                 rk[15] = rk[7] ^ rk[14];
@@ -805,35 +805,81 @@ public:
         /* apply the inverse MixColumn transform to all round keys but the first and the last: */
         for (i = 1; i < (key->rounds); i++) {
             rk += 4;
-            rk[0] =
-                Td0()[Te1()[(rk[0] >> 24)] & 0xff] ^
-                Td1()[Te1()[(rk[0] >> 16) & 0xff] & 0xff] ^
-                Td2()[Te1()[(rk[0] >> 8) & 0xff] & 0xff] ^
-                Td3()[Te1()[(rk[0]) & 0xff] & 0xff];
-            rk[1] =
-                Td0()[Te1()[(rk[1] >> 24)] & 0xff] ^
-                Td1()[Te1()[(rk[1] >> 16) & 0xff] & 0xff] ^
-                Td2()[Te1()[(rk[1] >> 8) & 0xff] & 0xff] ^
-                Td3()[Te1()[(rk[1]) & 0xff] & 0xff];
-            rk[2] =
-                Td0()[Te1()[(rk[2] >> 24)] & 0xff] ^
-                Td1()[Te1()[(rk[2] >> 16) & 0xff] & 0xff] ^
-                Td2()[Te1()[(rk[2] >> 8) & 0xff] & 0xff] ^
-                Td3()[Te1()[(rk[2]) & 0xff] & 0xff];
-            rk[3] =
-                Td0()[Te1()[(rk[3] >> 24)] & 0xff] ^
-                Td1()[Te1()[(rk[3] >> 16) & 0xff] & 0xff] ^
-                Td2()[Te1()[(rk[3] >> 8) & 0xff] & 0xff] ^
-                Td3()[Te1()[(rk[3]) & 0xff] & 0xff];
+            rk[0] = InvMixColumn(rk[0]);
+            rk[1] = InvMixColumn(rk[1]);
+            rk[2] = InvMixColumn(rk[2]);
+            rk[3] = InvMixColumn(rk[3]);
         }
         return 0;
     }
 
+    /**
+    * Select how blocks are run through the cipher, see aes_backend_type.
+    * The default is AES_BACKEND_AESNI when the cpu has it and AES_BACKEND_CONSTANT_TIME elsewhere,
+    * AES_BACKEND_TABLE is only used when asked for.
+    * Returns false, leaving the backend as it was, for AES_BACKEND_AESNI on a cpu without it.
+    */
+    static bool SetBackend(aes_backend_type backend)
+    {
+        if (backend == AES_BACKEND_AESNI && !HasAESNI()) {
+            return false;
+        }
+        Backend().store(backend, std::memory_order_relaxed);
+        return true;
+    }
+
+    static aes_backend_type GetBackend()
+    {
+        return (aes_backend_type)Backend().load(std::memory_order_relaxed);
+    }
+
+    /*
+    * Encrypt a single block with the selected backend
+    * in and out can overlap
+    */
+    static void EncryptBlock(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+    {
+        switch (Backend().load(std::memory_order_relaxed)) {
+#if defined(CPU_FEATURES_X86)
+        case AES_BACKEND_AESNI:
+            EncryptBlockAESNI(in, out, key);
+            break;
+#endif
+        case AES_BACKEND_CONSTANT_TIME:
+            EncryptBlockConstantTime(in, out, key);
+            break;
+        default:
+            EncryptBlockTable(in, out, key);
+            break;
+        }
+    }
+
+    /*
+    * Decrypt a single block with the selected backend
+    * in and out can overlap
+    */
+    static void DecryptBlock(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+    {
+        switch (Backend().load(std::memory_order_relaxed)) {
+#if defined(CPU_FEATURES_X86)
+        case AES_BACKEND_AESNI:
+            DecryptBlockAESNI(in, out, key);
+            break;
+#endif
+        case AES_BACKEND_CONSTANT_TIME:
+            DecryptBlockConstantTime(in, out, key);
+            break;
+        default:
+            DecryptBlockTable(in, out, key);
+            break;
+        }
+    }
+
     /*
-    * Encrypt a single block
+    * Encrypt a single block with the lookup tables
     * in and out can overlap
     */
-    static void EncryptBlock(const unsigned char *in, unsigned char *out, const AES_KEY *key) 
+    static void EncryptBlockTable(const unsigned char *in, unsigned char *out, const AES_KEY *key) 
     {
         const unsigned int *rk;
         unsigned int s0, s1, s2, s3, t0, t1, t2, t3;
@@ -946,10 +992,10 @@ public:
     }
 
     /*
-    * Decrypt a single block
+    * Decrypt a single block with the lookup tables
     * in and out can overlap
     */
-    static void DecryptBlock(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+    static void DecryptBlockTable(const unsigned char *in, unsigned char *out, const AES_KEY *key)
     {
 
         const unsigned int *rk;
@@ -1059,6 +1105,455 @@ public:
             rk[3];
         AES_PUTU32(out + 12, s3);
     }
+
+#if defined(CPU_FEATURES_X86)
+    /*
+    * Encrypt a single block with aesenc, only when the cpu has AES-NI
+    * in and out can overlap
+    */
+    CPU_TARGET("aes,ssse3")
+    static void EncryptBlockAESNI(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+    {
+        const __m128i order = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m128i *rk = (const __m128i *)key->rd_key;
+        __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), _mm_shuffle_epi8(_mm_loadu_si128(rk), order));
+        for (int r = 1; r < key->rounds; r++) {
+            s = _mm_aesenc_si128(s, _mm_shuffle_epi8(_mm_loadu_si128(rk + r), order));
+        }
+        s = _mm_aesenclast_si128(s, _mm_shuffle_epi8(_mm_loadu_si128(rk + key->rounds), order));
+        _mm_storeu_si128((__m128i *)out, s);
+    }
+
+    /*
+    * Decrypt a single block with aesdec, only when the cpu has AES-NI.
+    * the decryption key schedule already has InvMixColumns applied, as aesdec wants
+    * in and out can overlap
+    */
+    CPU_TARGET("aes,ssse3")
+    static void DecryptBlockAESNI(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+    {
+        const __m128i order = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        const __m128i *rk = (const __m128i *)key->rd_key;
+        __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), _mm_shuffle_epi8(_mm_loadu_si128(rk), order));
+        for (int r = 1; r < key->rounds; r++) {
+            s = _mm_aesdec_si128(s, _mm_shuffle_epi8(_mm_loadu_si128(rk + r), order));
+        }
+        s = _mm_aesdeclast_si128(s, _mm_shuffle_epi8(_mm_loadu_si128(rk + key->rounds), order));
+        _mm_storeu_si128((__m128i *)out, s);
+    }
+#endif
+
+    /*
+    * Encrypt a single block without lookup tables, the time taken does not depend on the key or the data
+    * in and out can overlap
+    */
+    static void EncryptBlockConstantTime(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+    {
+        unsigned int q[8];
+        Bitslice(in, q);
+        AddRoundKey(q, key->rd_key);
+        for (int r = 1; r <= key->rounds; r++) {
+            SubBytes(q);
+            ShiftRows(q, false);
+            if (r != key->rounds) {
+                MixColumns(q);
+            }
+            AddRoundKey(q, key->rd_key + 4 * r);
+        }
+        Unbitslice(q, out);
+    }
+
+    /*
+    * Decrypt a single block without lookup tables, the equivalent inverse cipher of FIPS-197 5.3.5
+    * in and out can overlap
+    */
+    static void DecryptBlockConstantTime(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+    {
+        unsigned int q[8];
+        Bitslice(in, q);
+        AddRoundKey(q, key->rd_key);
+        for (int r = 1; r <= key->rounds; r++) {
+            InvSubBytes(q);
+            ShiftRows(q, true);
+            if (r != key->rounds) {
+                InvMixColumns(q);
+            }
+            AddRoundKey(q, key->rd_key + 4 * r);
+        }
+        Unbitslice(q, out);
+    }
+
+private:
+    static std::atomic<int> &Backend()
+    {
+        static std::atomic<int> backend(HasAESNI() ? AES_BACKEND_AESNI : AES_BACKEND_CONSTANT_TIME);
+        return backend;
+    }
+
+    static bool HasAESNI()
+    {
+#if defined(CPU_FEATURES_X86)
+        return CpuFeatures::HasAESNI() && CpuFeatures::HasSSSE3();
+#else
+        return false;
+#endif
+    }
+
+    /*
+    * S-box applied to each byte of a key schedule word, the table backend keeps its lookups
+    */
+    static unsigned int SubWord(unsigned int w)
+    {
+        if (Backend().load(std::memory_order_relaxed) == AES_BACKEND_TABLE) {
+            return (Te2()[(w >> 24)] & 0xff000000) ^
+                (Te3()[(w >> 16) & 0xff] & 0x00ff0000) ^
+                (Te0()[(w >> 8) & 0xff] & 0x0000ff00) ^
+                (Te1()[(w) & 0xff] & 0x000000ff);
+        }
+        unsigned char b[16] = { 0 };
+        unsigned int q[8];
+        AES_PUTU32(b, w);
+        Bitslice(b, q);
+        SubBytes(q);
+        Unbitslice(q, b);
+        return AES_GETU32(b);
+    }
+
+    /*
+    * InvMixColumns of a decryption round key word
+    */
+    static unsigned int InvMixColumn(unsigned int w)
+    {
+        if (Backend().load(std::memory_order_relaxed) == AES_BACKEND_TABLE) {
+            return Td0()[Te1()[(w >> 24)] & 0xff] ^
+                Td1()[Te1()[(w >> 16) & 0xff] & 0xff] ^
+                Td2()[Te1()[(w >> 8) & 0xff] & 0xff] ^
+                Td3()[Te1()[(w) & 0xff] & 0xff];
+        }
+        unsigned char b[16] = { 0 };
+        unsigned int q[8];
+        AES_PUTU32(b, w);
+        Bitslice(b, q);
+        InvMixColumns(q);
+        Unbitslice(q, b);
+        return AES_GETU32(b);
+    }
+
+    /*
+    * The constant time backend keeps the block bitsliced: bit i of byte j is bit j of q[i],
+    * so one operation on the eight words works on that bit of all sixteen bytes at once.
+    * byte j is row j % 4 of column j / 4, as in FIPS-197
+    */
+
+    /* the 8x8 bit matrix of byte i, bit j at bit 8i + j, transposed */
+    static unsigned long long Transpose8(unsigned long long x)
+    {
+        unsigned long long t;
+        t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+        x ^= t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+        x ^= t ^ (t << 14);
+        t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+        x ^= t ^ (t << 28);
+        return x;
+    }
+
+    static void Bitslice(const unsigned char *in, unsigned int q[8])
+    {
+        unsigned long long low = 0, high = 0;
+        for (int i = 0; i < 8; i++) {
+            low |= (unsigned long long)in[i] << (8 * i);
+            high |= (unsigned long long)in[i + 8] << (8 * i);
+        }
+        low = Transpose8(low);
+        high = Transpose8(high);
+        for (int i = 0; i < 8; i++) {
+            q[i] = (unsigned int)((low >> (8 * i)) & 0xff) | (unsigned int)(((high >> (8 * i)) & 0xff) << 8);
+        }
+    }
+
+    static void Unbitslice(const unsigned int q[8], unsigned char *out)
+    {
+        unsigned long long low = 0, high = 0;
+        for (int i = 0; i < 8; i++) {
+            low |= (unsigned long long)(q[i] & 0xff) << (8 * i);
+            high |= (unsigned long long)((q[i] >> 8) & 0xff) << (8 * i);
+        }
+        low = Transpose8(low);
+        high = Transpose8(high);
+        for (int i = 0; i < 8; i++) {
+            out[i] = (unsigned char)(low >> (8 * i));
+            out[i + 8] = (unsigned char)(high >> (8 * i));
+        }
+    }
+
+    static void AddRoundKey(unsigned int q[8], const unsigned int *rk)
+    {
+        unsigned char b[16];
+        unsigned int k[8];
+        AES_PUTU32(b, rk[0]);
+        AES_PUTU32(b + 4, rk[1]);
+        AES_PUTU32(b + 8, rk[2]);
+        AES_PUTU32(b + 12, rk[3]);
+        Bitslice(b, k);
+        for (int i = 0; i < 8; i++) {
+            q[i] ^= k[i];
+        }
+    }
+
+    /*
+    * The S-box as a circuit of 113 xor, and, xnor gates (Boyar and Peralta,
+    * "A depth-16 circuit for the AES S-box"), the same gates whatever the input
+    */
+    static void SubBytes(unsigned int q[8])
+    {
+        unsigned int x0, x1, x2, x3, x4, x5, x6, x7;
+        unsigned int y1, y2, y3, y4, y5, y6, y7, y8, y9;
+        unsigned int y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+        unsigned int y20, y21;
+        unsigned int z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+        unsigned int z10, z11, z12, z13, z14, z15, z16, z17;
+        unsigned int t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+        unsigned int t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+        unsigned int t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+        unsigned int t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+        unsigned int t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+        unsigned int t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+        unsigned int t60, t61, t62, t63, t64, t65, t66, t67;
+        unsigned int s0, s1, s2, s3, s4, s5, s6, s7;
+
+        x0 = q[7];
+        x1 = q[6];
+        x2 = q[5];
+        x3 = q[4];
+        x4 = q[3];
+        x5 = q[2];
+        x6 = q[1];
+        x7 = q[0];
+
+        /* top linear transformation */
+        y14 = x3 ^ x5;
+        y13 = x0 ^ x6;
+        y9 = x0 ^ x3;
+        y8 = x0 ^ x5;
+        t0 = x1 ^ x2;
+        y1 = t0 ^ x7;
+        y4 = y1 ^ x3;
+        y12 = y13 ^ y14;
+        y2 = y1 ^ x0;
+        y5 = y1 ^ x6;
+        y3 = y5 ^ y8;
+        t1 = x4 ^ y12;
+        y15 = t1 ^ x5;
+        y20 = t1 ^ x1;
+        y6 = y15 ^ x7;
+        y10 = y15 ^ t0;
+        y11 = y20 ^ y9;
+        y7 = x7 ^ y11;
+        y17 = y10 ^ y11;
+        y19 = y10 ^ y8;
+        y16 = t0 ^ y11;
+        y21 = y13 ^ y16;
+        y18 = x0 ^ y16;
+
+        /* non-linear section */
+        t2 = y12 & y15;
+        t3 = y3 & y6;
+        t4 = t3 ^ t2;
+        t5 = y4 & x7;
+        t6 = t5 ^ t2;
+        t7 = y13 & y16;
+        t8 = y5 & y1;
+        t9 = t8 ^ t7;
+        t10 = y2 & y7;
+        t11 = t10 ^ t7;
+        t12 = y9 & y11;
+        t13 = y14 & y17;
+        t14 = t13 ^ t12;
+        t15 = y8 & y10;
+        t16 = t15 ^ t12;
+        t17 = t4 ^ t14;
+        t18 = t6 ^ t16;
+        t19 = t9 ^ t14;
+        t20 = t11 ^ t16;
+        t21 = t17 ^ y20;
+        t22 = t18 ^ y19;
+        t23 = t19 ^ y21;
+        t24 = t20 ^ y18;
+
+        t25 = t21 ^ t22;
+        t26 = t21 & t23;
+        t27 = t24 ^ t26;
+        t28 = t25 & t27;
+        t29 = t28 ^ t22;
+        t30 = t23 ^ t24;
+        t31 = t22 ^ t26;
+        t32 = t31 & t30;
+        t33 = t32 ^ t24;
+        t34 = t23 ^ t33;
+        t35 = t27 ^ t33;
+        t36 = t24 & t35;
+        t37 = t36 ^ t34;
+        t38 = t27 ^ t36;
+        t39 = t29 & t38;
+        t40 = t25 ^ t39;
+
+        t41 = t40 ^ t37;
+        t42 = t29 ^ t33;
+        t43 = t29 ^ t40;
+        t44 = t33 ^ t37;
+        t45 = t42 ^ t41;
+        z0 = t44 & y15;
+        z1 = t37 & y6;
+        z2 = t33 & x7;
+        z3 = t43 & y16;
+        z4 = t40 & y1;
+        z5 = t29 & y7;
+        z6 = t42 & y11;
+        z7 = t45 & y17;
+        z8 = t41 & y10;
+        z9 = t44 & y12;
+        z10 = t37 & y3;
+        z11 = t33 & y4;
+        z12 = t43 & y13;
+        z13 = t40 & y5;
+        z14 = t29 & y2;
+        z15 = t42 & y9;
+        z16 = t45 & y14;
+        z17 = t41 & y8;
+
+        /* bottom linear transformation */
+        t46 = z15 ^ z16;
+        t47 = z10 ^ z11;
+        t48 = z5 ^ z13;
+        t49 = z9 ^ z10;
+        t50 = z2 ^ z12;
+        t51 = z2 ^ z5;
+        t52 = z7 ^ z8;
+        t53 = z0 ^ z3;
+        t54 = z6 ^ z7;
+        t55 = z16 ^ z17;
+        t56 = z12 ^ t48;
+        t57 = t50 ^ t53;
+        t58 = z4 ^ t46;
+        t59 = z3 ^ t54;
+        t60 = t46 ^ t57;
+        t61 = z14 ^ t57;
+        t62 = t52 ^ t58;
+        t63 = t49 ^ t58;
+        t64 = z4 ^ t59;
+        t65 = t61 ^ t62;
+        t66 = z1 ^ t63;
+        s0 = t59 ^ t63;
+        s6 = t56 ^ ~t62;
+        s7 = t48 ^ ~t60;
+        t67 = t64 ^ t65;
+        s3 = t53 ^ t66;
+        s4 = t51 ^ t66;
+        s5 = t47 ^ t65;
+        s1 = t64 ^ ~s3;
+        s2 = t55 ^ ~t67;
+
+        q[7] = s0;
+        q[6] = s1;
+        q[5] = s2;
+        q[4] = s3;
+        q[3] = s4;
+        q[2] = s5;
+        q[1] = s6;
+        q[0] = s7;
+    }
+
+    /* the inverse of the affine transform of the S-box: rotations by 1, 3 and 6, then xor 0x05 */
+    static void InvAffine(unsigned int q[8])
+    {
+        unsigned int b[8];
+        for (int i = 0; i < 8; i++) {
+            b[i] = q[(i + 7) & 7] ^ q[(i + 5) & 7] ^ q[(i + 2) & 7];
+        }
+        for (int i = 0; i < 8; i++) {
+            q[i] = b[i];
+        }
+        q[0] = ~q[0];
+        q[2] = ~q[2];
+    }
+
+    /* S(x) is A(x^-1), so x^-1 is A^-1(S(x)) and the inverse S-box A^-1(S(A^-1(y))) */
+    static void InvSubBytes(unsigned int q[8])
+    {
+        InvAffine(q);
+        SubBytes(q);
+        InvAffine(q);
+    }
+
+    /* row r of the sixteen bit words rotated by r columns, left for ShiftRows, right for InvShiftRows */
+    static void ShiftRows(unsigned int q[8], bool inverse)
+    {
+        for (int i = 0; i < 8; i++) {
+            unsigned int x = q[i];
+            unsigned int row1 = x & 0x2222, row2 = x & 0x4444, row3 = x & 0x8888;
+            if (inverse) {
+                row1 = (row1 << 4) | (row1 >> 12);
+                row3 = (row3 << 12) | (row3 >> 4);
+            }
+            else {
+                row1 = (row1 >> 4) | (row1 << 12);
+                row3 = (row3 >> 12) | (row3 << 4);
+            }
+            row2 = (row2 >> 8) | (row2 << 8);
+            q[i] = (x & 0x1111) | (row1 & 0x2222) | (row2 & 0x4444) | (row3 & 0x8888);
+        }
+    }
+
+    /* byte i of each column replaced by byte i + 1 of the same column */
+    static unsigned int RotateColumn(unsigned int x)
+    {
+        return ((x >> 1) & 0x7777) | ((x << 3) & 0x8888);
+    }
+
+    /* each byte times x in GF(2^8), the reduction by 0x1b folds bit 7 into bits 0, 1, 3 and 4 */
+    static void XTime(const unsigned int a[8], unsigned int out[8])
+    {
+        unsigned int top = a[7];
+        out[7] = a[6];
+        out[6] = a[5];
+        out[5] = a[4];
+        out[4] = a[3] ^ top;
+        out[3] = a[2] ^ top;
+        out[2] = a[1];
+        out[1] = a[0] ^ top;
+        out[0] = top;
+    }
+
+    /* 2 a0 + 3 a1 + a2 + a3 for each byte of each column */
+    static void MixColumns(unsigned int q[8])
+    {
+        unsigned int r1[8], sum[8];
+        for (int i = 0; i < 8; i++) {
+            r1[i] = RotateColumn(q[i]);
+            sum[i] = q[i] ^ r1[i];
+        }
+        XTime(sum, sum);
+        for (int i = 0; i < 8; i++) {
+            unsigned int r2 = RotateColumn(r1[i]);
+            q[i] = sum[i] ^ r1[i] ^ r2 ^ RotateColumn(r2);
+        }
+    }
+
+    /* a0 and a2 get 4 (a0 + a2), a1 and a3 get 4 (a1 + a3), then MixColumns */
+    static void InvMixColumns(unsigned int q[8])
+    {
+        unsigned int t[8];
+        for (int i = 0; i < 8; i++) {
+            t[i] = q[i] ^ RotateColumn(RotateColumn(q[i]));
+        }
+        XTime(t, t);
+        XTime(t, t);
+        for (int i = 0; i < 8; i++) {
+            q[i] ^= t[i];
+        }
+        MixColumns(q);
+    }
 };
 
 class AES_ECB
@@ -6,6 +6,13 @@
 #include <string.h>
 #include <string>
 #include <fstream>
+#if defined(_MSC_VER)
+#include <template\table.h>
+#elif defined(__GNUC__)
+#include <template/table.h>
+#else
+#error unsupported compiler
+#endif
 
 class Base64Encoder
 {
@@ -376,7 +383,7 @@ public:
     */
     inline bool ProcessByte(const uint8_t input, uint8_t* output, size_t *output_size)
     {
-        char i = ConvToNumber(input);
+        int i = ConvToNumber(input);
         if (i >= 0) {
             m_buf[m_buf_size++] = (unsigned char)i;
         }
@@ -427,24 +434,10 @@ public:
     }
 
 private:
-    inline char ConvToNumber(char inByte)
+    inline int ConvToNumber(uint8_t inByte)
     {
-        if (inByte >= 'A' && inByte <= 'Z')
-            return (inByte - 'A');
-
-        if (inByte >= 'a' && inByte <= 'z')
-            return (inByte - 'a' + 26);
-
-        if (inByte >= '0' && inByte <= '9')
-            return (inByte - '0' + 52);
-
-        if (inByte == '+')
-            return (62);
-
-        if (inByte == '/')
-            return (63);
-
-        return (-1);
+        unsigned char value = stdex::static_table<unsigned char, 256, stdex::base64_value_gen>::value[inByte];
+        return value == 0xFF ? -1 : value;
     }
 
     inline bool DecodeQuantum(uint8_t* output, size_t *output_size)
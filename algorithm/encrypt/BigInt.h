@@ -34,16 +34,15 @@ public:
     class bit
     {
     public:
-        bit(const BigInt& ba) : _size(0)
+        bit(const BigInt& ba) : _bitvec(GetPool().Acquire()), _size(0)
         {
-            _bitvec = GetPool().GetResource();
-            if (_bitvec->Get().capacity() != GetMaxVectorSize()) {
-                _bitvec->Get().reserve(GetMaxVectorSize());
-            }
-            _bitvec->Get().insert(_bitvec->Get().begin(), ba._data->Get().begin(), ba._data->Get().end());
-            if (_bitvec->Get().size()) {
-                BigInt::base_t a = _bitvec->Get()[_bitvec->Get().size() - 1];
-                _size = _bitvec->Get().size() << (BigInt::basebit);
+            if (_bitvec->capacity() != GetMaxVectorSize()) {
+                _bitvec->reserve(GetMaxVectorSize());
+            }
+            _bitvec->insert(_bitvec->begin(), ba._data->Get().begin(), ba._data->Get().end());
+            if (_bitvec->size()) {
+                BigInt::base_t a = (*_bitvec)[_bitvec->size() - 1];
+                _size = _bitvec->size() << (BigInt::basebit);
                 BigInt::base_t t = 1 << (BigInt::basebitnum - 1);
                 if (a == 0) {
                     _size -= (BigInt::basebitnum);
@@ -57,12 +56,6 @@ public:
             }
         }
 
-        ~bit()
-        {
-            _bitvec->Get().clear();
-            GetPool().FreeResource(_bitvec);
-        }
-
         size_t size()
         {
             return _size;
@@ -72,11 +65,11 @@ public:
         {
             size_t index = i >> (BigInt::basebit); //get the bit index
             size_t off = i&(BigInt::basebitchar); //get the bit off
-            BigInt::base_t t = _bitvec->Get()[index]; //get the bit value
+            BigInt::base_t t = (*_bitvec)[index]; //get the bit value
             return (t&(1 << off)) != 0; //return the bit is 0 or 1
         }
     private:
-        Resource<data_t> * _bitvec; //org data
+        PooledPtr<data_t> _bitvec; //org data
         size_t _size; //valid bit num, not include the high zero bits
     };
 
@@ -94,7 +87,8 @@ public:
 
     static ResourcePool<data_t> &GetPool()
     {
-        static ResourcePool<data_t> pool;
+        //a burst of temporaries should not stay around for good
+        static ResourcePool<data_t> pool(0, 4096, std::chrono::seconds(10));
         return pool;
     }
 
@@ -548,7 +542,6 @@ public:
     ~BigInt()
     {
         if (_data) {
-            _data->Get().clear();
             GetPool().FreeResource(_data);
         }
     }
@@ -587,7 +580,6 @@ public:
     {
         if (this != &a) {
             if (_data) {
-                _data->Get().clear();
                 GetPool().FreeResource(_data);
                 _data = NULL;
             }
@@ -0,0 +1,239 @@
+#ifndef MONOTONIC_ARENA_H_INCLUDED
+#define MONOTONIC_ARENA_H_INCLUDED
+
+#include <new>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__has_include)
+#if __has_include(<memory_resource>) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L))
+#include <memory_resource>
+#endif
+#endif
+
+class MonotonicArena
+{
+    /**
+    *hands out memory by moving a pointer through big chunks and never frees
+    *single blocks. everything goes at once with Release or when the arena
+    *is destroyed, so objects built in it must not outlive that and their
+    *destructors must not need their memory back. not thread safe, use one
+    *arena per thread or per request
+    */
+public:
+    /**
+    *chunkSize: size of the first chunk, later ones double up to 64 times that
+    */
+    explicit MonotonicArena(size_t chunkSize = 4096) : chunks(NULL), buffer(NULL), bufferSize(0), chunkSize(chunkSize)
+    {
+        cur = end = NULL;
+        used = 0;
+    }
+
+    /**
+    *start with a caller owned buffer, e.g. on the stack, chunks are only
+    *allocated once it is full
+    */
+    MonotonicArena(void *buffer, size_t size, size_t chunkSize = 4096)
+        : chunks(NULL), buffer(static_cast<char*>(buffer)), bufferSize(size), chunkSize(chunkSize)
+    {
+        cur = this->buffer;
+        end = this->buffer + size;
+        used = 0;
+    }
+
+    ~MonotonicArena()
+    {
+        FreeChunks(NULL);
+    }
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator = (const MonotonicArena&) = delete;
+
+    /**
+    *size bytes aligned to align, throws std::bad_alloc when no chunk can be had
+    */
+    void* Allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        void *p = cur;
+        size_t space = end - cur;
+        if (!cur || !std::align(align, size, p, space)) {
+            Grow(size + align);
+            p = cur;
+            space = end - cur;
+            std::align(align, size, p, space);
+        }
+        cur = static_cast<char*>(p) + size;
+        used += size;
+        return p;
+    }
+
+    /**
+    *nothing to do, memory comes back with Release
+    */
+    void Deallocate(void*, size_t)
+    {
+    }
+
+    /**
+    *drop everything allocated so far. the newest chunk, also the biggest,
+    *is kept for the next round, so a steady load stops allocating
+    */
+    void Release()
+    {
+        FreeChunks(chunks);
+        if (chunks) {
+            chunks->prev = NULL;
+            cur = reinterpret_cast<char*>(chunks + 1);
+            end = cur + chunks->size;
+        }
+        else {
+            cur = buffer;
+            end = buffer + bufferSize;
+        }
+        used = 0;
+    }
+
+    /**
+    *bytes handed out since the last Release
+    */
+    size_t Used() const
+    {
+        return used;
+    }
+
+private:
+    struct Chunk
+    {
+        Chunk *prev;
+        size_t size;
+    };
+
+    void Grow(size_t need)
+    {
+        size_t size = chunks ? chunks->size * 2 : chunkSize;
+        if (size > chunkSize * 64) {
+            size = chunkSize * 64;
+        }
+        if (size < need) {
+            size = need;
+        }
+        if (size > SIZE_MAX - sizeof(Chunk)) {
+            throw std::bad_alloc();
+        }
+        Chunk *chunk = static_cast<Chunk*>(::operator new(sizeof(Chunk) + size));
+        chunk->prev = chunks;
+        chunk->size = size;
+        chunks = chunk;
+        cur = reinterpret_cast<char*>(chunk + 1);
+        end = cur + size;
+    }
+
+    //free the chunks older than keep, all of them for NULL
+    void FreeChunks(Chunk *keep)
+    {
+        Chunk *chunk = keep ? keep->prev : chunks;
+        while (chunk) {
+            Chunk *prev = chunk->prev;
+            ::operator delete(chunk);
+            chunk = prev;
+        }
+        if (!keep) {
+            chunks = NULL;
+        }
+    }
+
+    Chunk *chunks;
+    char *buffer;
+    size_t bufferSize;
+    size_t chunkSize;
+    char *cur;
+    char *end;
+    size_t used;
+};
+
+/**
+*standard allocator on top of an arena, for containers and allocate_shared
+*/
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind
+    {
+        typedef ArenaAllocator<U> other;
+    };
+
+    explicit ArenaAllocator(MonotonicArena &arena) : arena(&arena)
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t)
+    {
+    }
+
+    template<typename U>
+    bool operator == (const ArenaAllocator<U> &other) const
+    {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator != (const ArenaAllocator<U> &other) const
+    {
+        return arena != other.arena;
+    }
+
+    MonotonicArena *arena;
+};
+
+#if defined(__cpp_lib_memory_resource)
+
+/**
+*std::pmr view of an arena, for pmr containers
+*/
+class ArenaMemoryResource : public std::pmr::memory_resource
+{
+public:
+    explicit ArenaMemoryResource(MonotonicArena &arena) : arena(arena)
+    {
+    }
+
+private:
+    void* do_allocate(size_t size, size_t align) override
+    {
+        return arena.Allocate(size, align);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override
+    {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    MonotonicArena &arena;
+};
+
+#endif
+
+#endif
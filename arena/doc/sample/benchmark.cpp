@@ -0,0 +1,93 @@
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "MonotonicArena.h"
+#include "PacketParser.h"
+#include "Rsa.h"
+
+// counts every trip to the heap
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+// ethernet + ipv4 + tcp + an http request
+static const unsigned char packet[] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x08, 0x00,
+    0x45, 0x00, 0x00, 0x4d, 0x00, 0x01, 0x00, 0x00, 0x40, 0x06, 0x83, 0x1d, 0xc0, 0xa8,
+    0x01, 0x0a, 0x5d, 0xb8, 0xd8, 0x22, 0xc7, 0x38, 0x00, 0x50, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x50, 0x18, 0xff, 0xff, 0xa7, 0xeb, 0x00, 0x00, 0x47, 0x45,
+    0x54, 0x20, 0x2f, 0x20, 0x48, 0x54, 0x54, 0x50, 0x2f, 0x31, 0x2e, 0x31, 0x0d, 0x0a,
+    0x48, 0x6f, 0x73, 0x74, 0x3a, 0x20, 0x65, 0x78, 0x61, 0x6d, 0x70, 0x6c, 0x65, 0x2e,
+    0x63, 0x6f, 0x6d, 0x0d, 0x0a, 0x0d, 0x0a,
+};
+
+static void report(const char *name, size_t rounds, size_t allocs, std::chrono::steady_clock::duration used)
+{
+    std::cout << name << ": " << (double)allocs / rounds << " allocations/op, "
+        << std::chrono::duration_cast<std::chrono::nanoseconds>(used).count() / rounds << " ns/op" << std::endl;
+}
+
+static void parse_heap(size_t rounds)
+{
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        std::shared_ptr<NetBase> head = PacketParser::ParsePacketRaw(packet, sizeof(packet), true);
+    }
+    report("ParsePacketRaw heap ", rounds, allocations - before, std::chrono::steady_clock::now() - start);
+}
+
+// one arena per request, released after every packet
+static void parse_arena(size_t rounds)
+{
+    MonotonicArena arena;
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        {
+            std::shared_ptr<NetBase> head = PacketParser::ParsePacketRaw(packet, sizeof(packet), true, arena);
+        }
+        arena.Release();
+    }
+    report("ParsePacketRaw arena", rounds, allocations - before, std::chrono::steady_clock::now() - start);
+}
+
+// BigInt takes its buffers from a ResourcePool and they outlive the call,
+// so RSA is measured as is, to compare against
+static void rsa(size_t rounds)
+{
+    RSA rsa;
+    rsa.ReInitKeys(128);
+    BigInt m("123456789ABCDEF");
+    size_t before = allocations;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i) {
+        BigInt c = rsa.EncryptByPu(m);
+        BigInt d = rsa.DecodeByPr(c);
+    }
+    report("RSA encrypt+decrypt ", rounds, allocations - before, std::chrono::steady_clock::now() - start);
+}
+
+int main()
+{
+    parse_heap(200000);
+    parse_arena(200000);
+    rsa(20);
+    return 0;
+}
@@ -0,0 +1,672 @@
+#ifndef EVENT_CHANNEL_H
+#define EVENT_CHANNEL_H
+
+#if defined(_MSC_VER)
+#include <threadpool\ThreadPool.h>
+#include <event\RcuPtr.h>
+#elif defined(__GNUC__)
+#include <threadpool/ThreadPool.h>
+#include <event/RcuPtr.h>
+#else
+#error unsupported compiler
+#endif
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <condition_variable>
+
+/**
+*how a listener gets its events
+*/
+enum class EventDelivery
+{
+    Async,   //a pool task per listener and event
+    Batched, //one pool task per event calls all batched listeners in turn
+    Inline   //called on the dispatching thread, before the dispatch returns
+};
+
+/**
+*what a full lane of an ordered listener does with one more event
+*/
+enum class EventOverflow
+{
+    Block,      //the dispatching thread waits for room, a pool worker queues past the capacity
+    DropOldest, //the oldest queued event goes
+    DropNewest, //the new event goes
+    Coalesce    //the new event replaces the newest queued one with the same key, else the oldest goes
+};
+
+/**
+*how a listener is subscribed
+*/
+struct EventOptions
+{
+    explicit EventOptions(EventDelivery delivery = EventDelivery::Async)
+        : delivery(delivery), ordered(false), lanes(1), capacity(0), overflow(EventOverflow::Block)
+    {
+    }
+    EventDelivery delivery; //not used by ordered listeners
+    bool ordered;           //events are copied to a queue of the listener and run one at a time in dispatch order
+    size_t lanes;           //ordered with a key: events with the same key keep their order, lanes run in parallel
+    size_t capacity;        //ordered: most events queued per lane, 0 for no limit
+    EventOverflow overflow; //ordered: what a full lane does
+};
+
+/**
+*counters of an ordered listener
+*/
+struct EventStats
+{
+    size_t delivered; //events the listener was called with
+    size_t dropped;   //events lost to overflow
+    size_t coalesced; //events that replaced a queued one
+    size_t queued;    //events waiting now
+};
+
+/**
+*the queue of an ordered listener, whatever its event type
+*/
+class EventQueue
+{
+public:
+    virtual ~EventQueue()
+    {
+    }
+    virtual EventStats GetStats() const = 0;
+    /**
+    *queued events still run, a dispatcher blocked on the queue gives up
+    */
+    virtual void Close() = 0;
+};
+
+/**
+*what Subscribe returns, the key to UnSubscribe
+*/
+struct EventSubscription
+{
+    std::shared_ptr<void> id;          //the subscribed function
+    EventDelivery delivery;            //how the listener was subscribed
+    std::shared_ptr<EventQueue> queue; //the queue of an ordered listener
+};
+
+/**
+*lets EventHub keep the channels of all event types in one registry
+*/
+class EventChannelBase
+{
+public:
+    virtual ~EventChannelBase()
+    {
+    }
+    virtual void UnSubscribe(EventSubscription &&id) = 0;
+};
+
+/**
+*the listeners of one event type, resolved at compile time: no type lookup,
+*no casts, the listener list is read from a snapshot without a lock or a
+*shared write. an inline dispatch costs one store to the epoch record of the
+*thread and one call per listener. inline listeners run first, the event is
+*copied only when several tasks need it
+*/
+template <typename T>
+class EventChannel : public EventChannelBase
+{
+public:
+    typedef std::function<void(const T &)> Listener;
+    typedef std::function<void(T &)> OwnListener;
+    typedef EventSubscription ID;
+
+public:
+    /**
+    *pool: runs Async, Batched and ordered listeners, must outlive the channel,
+    *without one only Inline listeners can subscribe
+    */
+    explicit EventChannel(ThreadPool *pool = nullptr) : pool(pool), listeners()
+    {
+    }
+    EventChannel(const EventChannel &) = delete;
+    EventChannel &operator=(const EventChannel &) = delete;
+
+    /**
+    *Subscribe the event listener
+    *f: the callback, sees the dispatched event
+    *delivery: how f gets the events
+    */
+    ID Subscribe(const Listener &f, EventDelivery delivery = EventDelivery::Inline)
+    {
+        std::shared_ptr<Callback> ptr = std::make_shared<Callback>();
+        ptr->view = f;
+        return Add(ptr, delivery);
+    }
+
+    /**
+    *Subscribe a listener that may change the event, no other listener sees
+    *what it did. the only task of an event hands it the moved in event, the
+    *others give it a copy
+    */
+    ID SubscribeOwned(const OwnListener &f, EventDelivery delivery = EventDelivery::Inline)
+    {
+        std::shared_ptr<Callback> ptr = std::make_shared<Callback>();
+        ptr->own = f;
+        return Add(ptr, delivery);
+    }
+
+    /**
+    *Subscribe an ordered listener, it gets a copy of each event in its queue
+    *f: the callback, called with the queued copy
+    *options: lanes, capacity and overflow of the queue
+    *key: picks the lane of an event, all events share one lane without it
+    *note: with EventOverflow::Block, Dispatch waits while the lane is full,
+    *after every other listener has the event. on a worker of the pool, the
+    *callbacks of this channel included, the event is queued past capacity
+    *instead, the worker could be the one the lane waits for
+    */
+    ID SubscribeOrdered(const std::function<void(T &)> &f, const EventOptions &options,
+        const std::function<size_t(const T &)> &key = nullptr)
+    {
+        if (!pool)
+        {
+            throw std::invalid_argument("EventChannel without a pool only delivers inline");
+        }
+        //queued from the dispatching thread, the queue hands it to the pool
+        std::shared_ptr<OrderedQueue> queue = std::make_shared<OrderedQueue>(pool, f, key, options);
+        listeners.Update([&](Listeners &list)
+        {
+            list.ordered.push_back(queue);
+        });
+        return ID{ nullptr, EventDelivery::Inline, queue };
+    }
+
+    /**
+    *unsubscribe the event listener
+    *note: after call, id will be invalid
+    */
+    void UnSubscribe(ID &&id)
+    {
+        if (!id.id && !id.queue) return;
+        listeners.Update([&](Listeners &list)
+        {
+            if (id.queue)
+            {
+                Remove(list.ordered, std::static_pointer_cast<OrderedQueue>(id.queue));
+                return;
+            }
+            std::shared_ptr<Callback> f = std::static_pointer_cast<Callback>(id.id);
+            switch (id.delivery)
+            {
+            case EventDelivery::Inline:
+                Remove(list.inline_list, f);
+                break;
+            case EventDelivery::Batched:
+            {
+                if (!list.batched) return;
+                auto batched = std::make_shared<List>(*list.batched);
+                Remove(*batched, f);
+                list.batched = batched->empty() ? nullptr : batched;
+                break;
+            }
+            default:
+                Remove(list.async, f);
+                break;
+            }
+        });
+        if (id.queue) id.queue->Close();
+        id.id.reset();
+        id.queue.reset();
+    }
+
+    /**
+    *counters of an ordered listener, all zero for others
+    */
+    static EventStats GetStats(const ID &id)
+    {
+        if (!id.queue) return EventStats{ 0, 0, 0, 0 };
+        return id.queue->GetStats();
+    }
+
+    /**
+    *dispatch the event to the listerners
+    *return false if a listener could not be posted or an inline one threw
+    */
+    bool Dispatch(const T &s)
+    {
+        return DispatchTo(s);
+    }
+
+    /**
+    *as above, a single task gets s moved in
+    */
+    bool Dispatch(T &&s)
+    {
+        return DispatchTo(std::move(s));
+    }
+
+private:
+    class OrderedQueue;
+
+    //a subscribed function, view for the listeners that only look, own for
+    //those that get an event of their own
+    struct Callback
+    {
+        Listener view;
+        OwnListener own;
+    };
+
+    typedef std::vector<std::shared_ptr<Callback>> List;
+
+    struct Listeners
+    {
+        List inline_list;
+        std::shared_ptr<const List> batched; //shared with the batch tasks in flight
+        List async;
+        std::vector<std::shared_ptr<OrderedQueue>> ordered;
+    };
+
+    ID Add(const std::shared_ptr<Callback> &ptr, EventDelivery delivery)
+    {
+        if (delivery != EventDelivery::Inline && !pool)
+        {
+            throw std::invalid_argument("EventChannel without a pool only delivers inline");
+        }
+        listeners.Update([&](Listeners &list)
+        {
+            switch (delivery)
+            {
+            case EventDelivery::Inline:
+                list.inline_list.push_back(ptr);
+                break;
+            case EventDelivery::Batched:
+            {
+                auto batched = list.batched ? std::make_shared<List>(*list.batched) : std::make_shared<List>();
+                batched->push_back(ptr);
+                list.batched = batched;
+                break;
+            }
+            default:
+                list.async.push_back(ptr);
+                break;
+            }
+        });
+        return ID{ ptr, delivery, nullptr };
+    }
+
+    //mine: the event itself when nobody reads it after f, an own listener
+    //then changes it in place instead of a copy
+    static void Call(const Callback &f, const T &s, T *mine = nullptr)
+    {
+        if (f.view)
+        {
+            f.view(s);
+            return;
+        }
+        if (mine)
+        {
+            f.own(*mine);
+            return;
+        }
+        T copy(s);
+        f.own(copy);
+    }
+
+    template <typename V>
+    bool DispatchTo(V &&s)
+    {
+        bool ret = true;
+        //ordered listeners with a full lane, waited for without the snapshot
+        std::vector<std::shared_ptr<OrderedQueue>> blocked;
+        {
+            typename RcuPtr<Listeners>::Reader list(listeners);
+            for (auto &queue : list->ordered)
+            {
+                try
+                {
+                    if (!queue->Offer(s)) blocked.push_back(queue);
+                }
+                catch (...)
+                {
+                    ret = false;
+                }
+            }
+            for (auto &f : list->inline_list)
+            {
+                try
+                {
+                    Call(*f, s);
+                }
+                catch (...)
+                {
+                    ret = false;
+                }
+            }
+            if (blocked.empty())
+            {
+                ret = PostTasks(*list, std::forward<V>(s)) && ret;
+            }
+            else
+            {
+                //s is still needed below
+                ret = PostTasks(*list, static_cast<const T &>(s)) && ret;
+            }
+        }
+        for (auto &queue : blocked)
+        {
+            try
+            {
+                queue->Push(s);
+            }
+            catch (...)
+            {
+                ret = false;
+            }
+        }
+        return ret;
+    }
+
+    template <typename V>
+    bool PostTasks(const Listeners &list, V &&s)
+    {
+        bool ret = true;
+        size_t tasks = list.async.size() + (list.batched ? 1 : 0);
+        if (tasks == 0) return ret;
+        if (tasks == 1)
+        {
+            //built in the task, s is moved once
+            if (list.batched)
+            {
+                return Post(BatchTask<Owned>(list.batched, std::forward<V>(s)));
+            }
+            return Post(AsyncTask<Owned>(list.async[0], std::forward<V>(s)));
+        }
+
+        Shared payload(std::make_shared<T>(std::forward<V>(s)));
+        for (auto &f : list.async)
+        {
+            ret = Post(AsyncTask<Shared>(f, payload)) && ret;
+        }
+        if (list.batched)
+        {
+            ret = Post(BatchTask<Shared>(list.batched, payload)) && ret;
+        }
+        return ret;
+    }
+
+    template <typename V>
+    static void Remove(std::vector<V> &list, const V &f)
+    {
+        auto it = std::find(list.begin(), list.end(), f);
+        if (it != list.end()) list.erase(it);
+    }
+
+    //the event of the only task, moved in, the task may hand it out
+    struct Owned
+    {
+        explicit Owned(T &&value) : value(std::move(value)) {}
+        explicit Owned(const T &value) : value(value) {}
+        const T &Get() const { return value; }
+        T *Mine() { return &value; }
+        T value;
+    };
+
+    //the event shared by several tasks
+    struct Shared
+    {
+        explicit Shared(std::shared_ptr<const T> value) : value(std::move(value)) {}
+        const T &Get() const { return *value; }
+        T *Mine() { return nullptr; }
+        std::shared_ptr<const T> value;
+    };
+
+    template <typename Payload>
+    struct AsyncTask
+    {
+        template <typename V>
+        AsyncTask(const std::shared_ptr<Callback> &f, V &&value) : f(f), payload(std::forward<V>(value)) {}
+        void operator()()
+        {
+            Call(*f, payload.Get(), payload.Mine());
+        }
+        std::shared_ptr<Callback> f;
+        Payload payload;
+    };
+
+    template <typename Payload>
+    struct BatchTask
+    {
+        template <typename V>
+        BatchTask(const std::shared_ptr<const List> &list, V &&value) : list(list), payload(std::forward<V>(value)) {}
+        void operator()()
+        {
+            //one listener throwing does not keep the event from the others,
+            //the last one may have the event itself
+            for (size_t i = 0; i < list->size(); ++i)
+            {
+                try
+                {
+                    Call(*(*list)[i], payload.Get(), i + 1 == list->size() ? payload.Mine() : nullptr);
+                }
+                catch (...)
+                {
+                }
+            }
+        }
+        std::shared_ptr<const List> list;
+        Payload payload;
+    };
+
+    //the queue of an ordered listener, one serial lane per key slot. a lane
+    //with events has one drain task in the pool, so its events never overlap
+    class OrderedQueue : public EventQueue, public std::enable_shared_from_this<OrderedQueue>
+    {
+    public:
+        OrderedQueue(ThreadPool *pool, const std::function<void(T &)> &f, const std::function<size_t(const T &)> &key, const EventOptions &options)
+            : pool(pool), f(f), key(key), lanes(options.lanes ? options.lanes : 1), capacity(options.capacity), overflow(options.overflow),
+            closed(false), delivered(0), dropped(0), coalesced(0)
+        {
+        }
+
+        /**
+        *queue the event unless its lane is full and the queue blocks, false
+        *then and the dispatcher calls Push once it let go of its snapshot
+        */
+        bool Offer(const T &value)
+        {
+            size_t k = key ? key(value) : 0;
+            size_t index = k % lanes.size();
+            Lane &lane = lanes[index];
+            std::unique_lock<std::mutex> lock(lane.mutex);
+            if (closed) return true;
+            if (capacity && lane.items.size() >= capacity)
+            {
+                switch (overflow)
+                {
+                case EventOverflow::Block:
+                    if (!pool->on_worker()) return false;
+                    //the worker may be the one the lane waits for, nothing is lost
+                    break;
+                case EventOverflow::DropNewest:
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                case EventOverflow::Coalesce:
+                    for (auto it = lane.items.rbegin(); it != lane.items.rend(); ++it)
+                    {
+                        if (it->key == k)
+                        {
+                            if (!Replace(*it, k, value)) break;
+                            coalesced.fetch_add(1, std::memory_order_relaxed);
+                            return true;
+                        }
+                    }
+                    lane.items.pop_front();
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                default:
+                    lane.items.pop_front();
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            Append(lane, index, k, value);
+            return true;
+        }
+
+        /**
+        *wait for room in the lane and queue the event, not on a pool worker
+        */
+        void Push(const T &value)
+        {
+            size_t k = key ? key(value) : 0;
+            size_t index = k % lanes.size();
+            Lane &lane = lanes[index];
+            std::unique_lock<std::mutex> lock(lane.mutex);
+            lane.space.wait(lock, [&] { return closed || lane.items.size() < capacity; });
+            if (closed) return;
+            Append(lane, index, k, value);
+        }
+
+        EventStats GetStats() const
+        {
+            EventStats stats = { delivered.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed),
+                coalesced.load(std::memory_order_relaxed), 0 };
+            for (auto &lane : lanes)
+            {
+                std::unique_lock<std::mutex> lock(lane.mutex);
+                stats.queued += lane.items.size();
+            }
+            return stats;
+        }
+
+        void Close()
+        {
+            for (auto &lane : lanes)
+            {
+                std::unique_lock<std::mutex> lock(lane.mutex);
+                closed = true;
+                lane.space.notify_all();
+            }
+        }
+
+    private:
+        struct Item
+        {
+            size_t key;
+            T value;
+        };
+
+        struct Lane
+        {
+            Lane() : scheduled(false) {}
+            mutable std::mutex mutex;
+            std::condition_variable space;
+            std::deque<Item> items;
+            bool scheduled;
+        };
+
+        //in place, so T need not be assignable. a move that may throw could
+        //leave a destroyed item in the lane, such types go the DropOldest way
+        static bool Replace(Item &item, size_t k, const T &value)
+        {
+            if (!std::is_nothrow_move_constructible<Item>::value) return false;
+            Item fresh{ k, value };
+            item.~Item();
+            new (&item) Item(std::move(fresh));
+            return true;
+        }
+
+        //called with the lane locked
+        void Append(Lane &lane, size_t index, size_t k, const T &value)
+        {
+            lane.items.push_back(Item{ k, value });
+            if (!lane.scheduled)
+            {
+                Schedule(lane, index);
+            }
+        }
+
+        //called with the lane locked, throws when the pool is stopped
+        void Schedule(Lane &lane, size_t index)
+        {
+            std::shared_ptr<OrderedQueue> self = this->shared_from_this();
+            pool->post([self, index] { self->Drain(index); });
+            lane.scheduled = true;
+        }
+
+        //a bounded batch, then the lane goes to the back of the pool queue
+        void Drain(size_t index)
+        {
+            Lane &lane = lanes[index];
+            for (size_t done = 0; done < 64; ++done)
+            {
+                //T need not be default constructible
+                typename std::aligned_storage<sizeof(Item), alignof(Item)>::type storage;
+                Item *item;
+                {
+                    std::unique_lock<std::mutex> lock(lane.mutex);
+                    if (lane.items.empty())
+                    {
+                        lane.scheduled = false;
+                        return;
+                    }
+                    item = new (&storage) Item(std::move(lane.items.front()));
+                    lane.items.pop_front();
+                    lane.space.notify_one();
+                }
+                try
+                {
+                    f(item->value);
+                }
+                catch (...)
+                {
+                }
+                item->~Item();
+                delivered.fetch_add(1, std::memory_order_relaxed);
+            }
+            std::unique_lock<std::mutex> lock(lane.mutex);
+            lane.scheduled = false;
+            if (!lane.items.empty())
+            {
+                try
+                {
+                    Schedule(lane, index);
+                }
+                catch (...)
+                {
+                }
+            }
+        }
+
+        ThreadPool *pool; //outlives every task it runs
+        std::function<void(T &)> f;
+        std::function<size_t(const T &)> key;
+        std::vector<Lane> lanes;
+        size_t capacity;
+        EventOverflow overflow;
+        std::atomic<bool> closed;
+        std::atomic<size_t> delivered;
+        std::atomic<size_t> dropped;
+        std::atomic<size_t> coalesced;
+    };
+
+    template <typename F>
+    bool Post(F &&task)
+    {
+        try
+        {
+            pool->post(std::forward<F>(task));
+        }
+        catch (...)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    ThreadPool *pool;
+    RcuPtr<Listeners> listeners;
+};
+
+#endif // !EVENT_CHANNEL_H
@@ -6,27 +6,129 @@
 #include <Windows.h>
 #include <WinSock2.h>
 #include <threadpool\ThreadPool.h>
+#include <event\RcuPtr.h>
+#include <event\EventChannel.h>
 #elif defined(__GNUC__)
 #include <threadpool/ThreadPool.h>
+#include <event/RcuPtr.h>
+#include <event/EventChannel.h>
 #else
 #error unsupported compiler
 #endif
 #include <map>
 #include <vector>
 #include <functional>
+#include <algorithm>
 #include <mutex>
 
+/**
+*an event of any type, what the void listeners of EventHub get. made from the
+*dispatched object it only refers to it, a copy owns a copy of the object
+*/
+class AnyEvent
+{
+public:
+    /**
+    *movable: value is an rvalue nobody reads anymore, the first AnyEvent moved
+    *from this one takes it over with a move instead of a copy
+    */
+    template <typename V>
+    explicit AnyEvent(const V &value, bool movable = false) : owned(nullptr), value(&value), movable(movable), type(&TypeOf<V>())
+    {
+    }
+    AnyEvent(const AnyEvent &other) : owned(other.type->clone(other.value)), value(owned), movable(false), type(other.type)
+    {
+    }
+    AnyEvent(AnyEvent &&other) : owned(other.Take()), value(owned), movable(false), type(other.type)
+    {
+    }
+    ~AnyEvent()
+    {
+        if (owned) type->destroy(owned);
+    }
+    AnyEvent &operator=(const AnyEvent &) = delete;
+
+    const void *Get() const { return value; }
+    /**
+    *the object a copy owns, nullptr for the one made from the dispatched object
+    */
+    void *Get() { return owned; }
+
+private:
+    struct Type
+    {
+        void *(*clone)(const void *);
+        void *(*move)(void *);
+        void (*destroy)(void *);
+    };
+
+    //what a move leaves with the new AnyEvent, this one is empty after it
+    void *Take()
+    {
+        void *taken = owned ? owned : movable ? type->move(const_cast<void *>(value)) : type->clone(value);
+        owned = nullptr;
+        value = nullptr;
+        movable = false;
+        return taken;
+    }
+
+    template <typename V>
+    static void *Clone(const void *value)
+    {
+        return new V(*static_cast<const V *>(value));
+    }
+
+    template <typename V>
+    static void *Move(void *value)
+    {
+        return new V(std::move(*static_cast<V *>(value)));
+    }
+
+    template <typename V>
+    static void Destroy(void *value)
+    {
+        delete static_cast<V *>(value);
+    }
+
+    template <typename V>
+    static const Type &TypeOf()
+    {
+        static const Type type = { &Clone<V>, &Move<V>, &Destroy<V> };
+        return type;
+    }
+
+    void *owned;
+    const void *value;
+    bool movable;
+    const Type *type;
+};
+
+/**
+*the dynamic facade over event channels: events by id and runtime type. each
+*event id and type has one EventChannel, the void listeners of an event share
+*an EventChannel<AnyEvent>. code that knows its event type at compile time
+*should hold the EventChannel from Channel and dispatch to it, that skips the
+*lookup of the channel
+*/
 class EventHub
 {
 public:
-    class ID
+    typedef EventDelivery Delivery;
+    typedef EventOverflow Overflow;
+    typedef EventOptions Options;
+    typedef EventStats Stats;
+
+    class ID : public EventSubscription
     {
     public:
-        size_t type_hash; //Subscribe Event type hash
-        std::shared_ptr<std::function<void(u_int, void *)>> id; //a wrapper function ptr of Subscribe Event function
+        size_t type_hash; //the key of the Subscribe Event type
     };
 public:
-    EventHub(u_int pool_size = 0) : pool(std::make_shared<ThreadPool>(pool_size)), obj_mutex(), listeners()
+    /**
+    *pool_size: worker count of the callback pool, 0 means an elastic pool that
+    *grows up to the core count while events back up and shrinks when idle
+    */
+    EventHub(u_int pool_size = 0) : pool_mutex(), pool(MakePool(pool_size)), listeners()
     {
     }
     virtual ~EventHub()
@@ -38,22 +140,60 @@ public:
     *event: the event want to listen
     *f: the callback
     *T: the type, if T is void, then it will receive all type of this event
+    *delivery: Inline suits tiny handlers, they must not block, Batched saves a
+    *task per listener when many listen to a busy event
+    *note: with a const T (or const void) f sees the dispatched event itself,
+    *otherwise f gets an event of its own to change, no listener sees what
+    *another did. the only task of an event hands over the moved in event,
+    *inline listeners and tasks that share the event get a copy
     */
     template <typename T>
-    ID SubscribeEvent(u_int event, const std::function<void(u_int, T *)> &f)
+    ID SubscribeEvent(u_int event, const std::function<void(u_int, T *)> &f, Delivery delivery = Delivery::Async)
     {
         typedef typename std::remove_cv<T>::type type;
-        size_t type_hash = typeid(type).hash_code();
-        std::shared_ptr<std::function<void(u_int, void *)>> ptr;
+        typedef typename std::conditional<std::is_void<type>::value, AnyEvent, type>::type value_type;
+        return MakeID(TypeKey<value_type>(), Listen(ChannelOf<value_type>(event), event, f, delivery));
+    }
+
+    /**
+    *Subscribe the event listener with options, T can not be void
+    *key: for ordered listeners with lanes, picks the lane of an event, all events share one lane without it
+    *note: an ordered listener with Overflow::Block makes DispatchEvent wait while its lane is full, after
+    *every other listener has the event. on a worker of the hub pool, its own callbacks included, the
+    *event is queued past capacity instead, the worker could be the one the lane waits for
+    */
+    template <typename T>
+    ID SubscribeEvent(u_int event, const std::function<void(u_int, T *)> &f, const Options &options,
+        const std::function<size_t(const T &)> &key = nullptr)
+    {
+        if (!options.ordered)
         {
-            std::unique_lock<std::mutex> lock(obj_mutex);
-            ptr = std::make_shared<std::function<void(u_int, void *)>>([f](u_int var1, void *var2)
-            {
-                f(var1, (type *)var2);
-            });
-            listeners[event][type_hash].emplace_back(ptr);
+            return SubscribeEvent<T>(event, f, options.delivery);
         }
-        return ID{ type_hash, ptr };
+        typedef typename std::remove_cv<T>::type type;
+        //the queued copy is the listener's own
+        std::function<void(type &)> ordered = [f, event](type &s) { f(event, &s); };
+        return MakeID(TypeKey<type>(), ChannelOf<type>(event).SubscribeOrdered(ordered, options, key));
+    }
+
+    /**
+    *the typed channel of event and T, created on first use and kept as long
+    *as the hub. it holds the listeners SubscribeEvent adds for this event and
+    *type, dispatching to it reaches them as DispatchEvent does
+    */
+    template <typename T>
+    EventChannel<typename std::remove_cv<T>::type> &Channel(u_int event)
+    {
+        return ChannelOf<typename std::remove_cv<T>::type>(event);
+    }
+
+    /**
+    *counters of an ordered listener, all zero for others
+    */
+    Stats GetStats(const ID &id) const
+    {
+        if (!id.queue) return Stats{ 0, 0, 0, 0 };
+        return id.queue->GetStats();
     }
 
     /**
@@ -64,86 +204,180 @@ public:
     */
     void UnSubscribeEvent(u_int event, ID &&id)
     {
-        if (!id.id) return;
+        if (!id.id && !id.queue) return;
+        EventChannelBase *channel = nullptr;
         {
-            std::unique_lock<std::mutex> lock(obj_mutex);
-            auto it = listeners[event][id.type_hash].begin();
-            auto end = listeners[event][id.type_hash].end();
-            for (; it != end; it++)
-            {
-                if (*it == id.id) break;
-            }
-            if (it != end) listeners[event][id.type_hash].erase(it);
+            RcuPtr<Table>::Reader table(listeners);
+            auto types = table->find(event);
+            if (types == table->end()) return;
+            channel = Find(types->second, id.type_hash);
         }
-        id.id.reset();
+        //channels live as long as the hub
+        if (channel) channel->UnSubscribe(std::move(id));
     }
 
     /**
     *dispatch the event to the listerners.
     *event: the event that need to dispatch
     *s: the event parameter
+    *return false if a listener could not be posted or an inline one threw
     *note: the parameter s type must have copy instructer
+    *note: no lock is taken, the listeners are read from a snapshot, a listener
+    *subscribed or unsubscribed while this runs may or may not get the event
+    *note: the listeners of the type get the event first, then the void ones.
+    *the event is copied for the tasks only when more than one task needs it,
+    *a single task gets s moved in
     */
     template <typename T>
     bool DispatchEvent(u_int event, T &&s)
     {
-        typedef typename std::remove_reference<T>::type type;
-
-        size_t type_hash = typeid(type).hash_code();
-        bool ret = true;
-        auto ptr = std::make_shared<type>(std::forward<T>(s));
+        typedef typename std::remove_cv<typename std::remove_reference<T>::type>::type value_type;
 
-        std::unique_lock<std::mutex> lock(obj_mutex);
-        for (auto f : listeners[event][type_hash])
-        {//listener who has the same type of the event will recv the event
-            try
-            {
-                pool->enqueue([event, f, ptr]
-                {
-                    (*f)(event, (void *)ptr.get());
-                });
-            }
-            catch (...)
+        EventChannelBase *typed = nullptr;
+        EventChannelBase *untyped = nullptr;
+        {
+            RcuPtr<Table>::Reader table(listeners);
+            auto types = table->find(event);
+            if (types == table->end()) return true;
+            for (auto &type : types->second)
             {
-                ret = false;
+                if (type.key == TypeKey<value_type>()) typed = type.channel.get();
+                else if (type.key == TypeKey<AnyEvent>()) untyped = type.channel.get();
             }
         }
-
-        for (auto f : listeners[event][typeid(void).hash_code()])
-        {//listener who has void type of the event will recv the event
-            try
-            {
-                pool->enqueue([event, f, ptr]
-                {
-                    (*f)(event, (void *)ptr.get());
-                });
-            }
-            catch (...)
-            {
-                ret = false;
-            }
+        //channels live as long as the hub, they are used without the snapshot
+        if (!untyped)
+        {
+            return !typed || static_cast<EventChannel<value_type> *>(typed)->Dispatch(std::forward<T>(s));
         }
-        return ret;
+        bool ret = true;
+        if (typed) ret = static_cast<EventChannel<value_type> *>(typed)->Dispatch(static_cast<const value_type &>(s));
+        //the typed listeners are done with s, the void ones may take it
+        const bool movable = !std::is_lvalue_reference<T>::value && !std::is_const<typename std::remove_reference<T>::type>::value;
+        return static_cast<EventChannel<AnyEvent> *>(untyped)->Dispatch(AnyEvent(static_cast<const value_type &>(s), movable)) && ret;
     }
 
     /**
-    *reset the thread pool size
+    *reset the thread pool size, the pool is resized in place so queued
+    *callbacks are kept
     */
     void ReSetPool(u_int pool_size)
     {
-        std::shared_ptr<ThreadPool> tmp_pool;
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        if (pool_size)
         {
-            std::unique_lock<std::mutex> lock(obj_mutex);
-            tmp_pool.swap(pool);
-            pool = std::make_shared<ThreadPool>(pool_size);
+            pool->resize(pool_size);
+        }
+        else
+        {
+            pool->resize(0, MaxElasticSize());
         }
     }
 
 private:
-    std::mutex obj_mutex;//listeners lock
+    //the channel of one event type, never dropped
+    struct Type
+    {
+        size_t key;
+        std::shared_ptr<EventChannelBase> channel;
+    };
+
+    //the key is event, a vector is scanned faster than a map for the few types of an event
+    typedef std::map<u_int, std::vector<Type>> Table;
+
+    //one address per type, taken without the typeid hash
+    template <typename T>
+    static size_t TypeKey()
+    {
+        static const char key = 0;
+        return reinterpret_cast<size_t>(&key);
+    }
+
+    static EventChannelBase *Find(const std::vector<Type> &types, size_t key)
+    {
+        for (auto &type : types)
+        {
+            if (type.key == key) return type.channel.get();
+        }
+        return nullptr;
+    }
+
+    template <typename T>
+    EventChannel<T> &ChannelOf(u_int event)
+    {
+        size_t key = TypeKey<T>();
+        EventChannelBase *channel = nullptr;
+        {
+            RcuPtr<Table>::Reader table(listeners);
+            auto types = table->find(event);
+            if (types != table->end()) channel = Find(types->second, key);
+        }
+        if (!channel)
+        {
+            listeners.Update([&](Table &table)
+            {
+                std::vector<Type> &types = table[event];
+                channel = Find(types, key);
+                if (!channel)
+                {
+                    types.push_back(Type{ key, std::make_shared<EventChannel<T>>(pool.get()) });
+                    channel = types.back().channel.get();
+                }
+            });
+        }
+        return static_cast<EventChannel<T> &>(*channel);
+    }
+
+    static ID MakeID(size_t type_hash, EventSubscription &&subscription)
+    {
+        ID id;
+        static_cast<EventSubscription &>(id) = std::move(subscription);
+        id.type_hash = type_hash;
+        return id;
+    }
+
+    //a listener of a const type sees the event itself
+    template <typename T>
+    static EventSubscription Listen(EventChannel<T> &channel, u_int event, const std::function<void(u_int, const T *)> &f, Delivery delivery)
+    {
+        return channel.Subscribe([f, event](const T &s) { f(event, &s); }, delivery);
+    }
+
+    //the others get an event of their own, see SubscribeOwned
+    template <typename T>
+    static EventSubscription Listen(EventChannel<T> &channel, u_int event, const std::function<void(u_int, T *)> &f, Delivery delivery)
+    {
+        return channel.SubscribeOwned([f, event](T &s) { f(event, &s); }, delivery);
+    }
+
+    static EventSubscription Listen(EventChannel<AnyEvent> &channel, u_int event, const std::function<void(u_int, const void *)> &f, Delivery delivery)
+    {
+        return channel.Subscribe([f, event](const AnyEvent &s) { f(event, s.Get()); }, delivery);
+    }
+
+    static EventSubscription Listen(EventChannel<AnyEvent> &channel, u_int event, const std::function<void(u_int, void *)> &f, Delivery delivery)
+    {
+        return channel.SubscribeOwned([f, event](AnyEvent &s) { f(event, s.Get()); }, delivery);
+    }
+
+    static std::shared_ptr<ThreadPool> MakePool(u_int pool_size)
+    {
+        if (pool_size)
+        {
+            return std::make_shared<ThreadPool>(pool_size);
+        }
+        return std::make_shared<ThreadPool>(0, MaxElasticSize());
+    }
+
+    static size_t MaxElasticSize()
+    {
+        size_t cores = std::thread::hardware_concurrency();
+        return cores ? cores : 1;
+    }
+
+    std::mutex pool_mutex;//ReSetPool lock
     std::shared_ptr<ThreadPool> pool;//used to deal the event callback
-    //the first map key is event, the second map key is type of SubscribeEvent, the second value is a list of function, which is a wrapper of SubscribeEvent funtion
-    std::map<u_int, std::map<size_t, std::vector<std::shared_ptr<std::function<void(u_int, void *)>>>>> listeners;
+    RcuPtr<Table> listeners;//the channels by event, copied when one is added, read without lock
 };
 
 #endif // !EVENT_ENGINE_H
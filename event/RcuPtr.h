@@ -0,0 +1,354 @@
+#ifndef EVENT_RCU_PTR_H
+#define EVENT_RCU_PTR_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/**
+*the grace periods shared by every RcuPtr. each thread owns a record with the
+*epoch it entered its outermost read section at, 0 outside, so a read only
+*writes to its own cache line. a replaced copy is tagged with the epoch its
+*replacement opened and freed once every thread inside entered at or after it.
+*where the os can fence every thread of the process (membarrier on linux,
+*FlushProcessWriteBuffers on windows) the collector pays for the fences and
+*readers get by with plain stores
+*/
+class RcuDomain
+{
+public:
+    /**
+    *enter a read section, nested sections of any RcuPtr share the outermost.
+    *returns the epoch the section protects, see Leave
+    */
+    static uint64_t Enter()
+    {
+        ThreadState &state = State();
+        if (state.depth++ == 0)
+        {
+            RcuDomain &domain = Get();
+            if (!state.record)
+            {
+                state.record = domain.Acquire();
+            }
+            state.record->epoch.store(domain.epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            //the copy loaded next must not be read before the record is visible
+            domain.ReaderFence();
+        }
+        return state.record->epoch.load(std::memory_order_relaxed);
+    }
+
+    /**
+    *leave a read section. a reader that entered before the newest replaced
+    *copy may be the one holding it back, so it collects on the way out
+    */
+    static void Leave(uint64_t entered)
+    {
+        ThreadState &state = State();
+        if (--state.depth != 0)
+        {
+            return;
+        }
+        RcuDomain &domain = Get();
+        state.record->epoch.store(0, std::memory_order_release);
+        if (state.dead)
+        {
+            //past the thread local destructors, nothing gives the record back later
+            domain.Release(state.record);
+            state.record = NULL;
+        }
+        //pairs with the fence in Collect, either it sees us gone or we see newest
+        domain.ReaderFence();
+        if (domain.newest.load(std::memory_order_relaxed) > entered)
+        {
+            domain.Collect();
+        }
+    }
+
+    /**
+    *hand over a copy that was just replaced, it is freed with destroy when no
+    *reader can hold it anymore
+    */
+    static void Retire(const void *old, void (*destroy)(const void *))
+    {
+        RcuDomain &domain = Get();
+        {
+            std::unique_lock<std::mutex> lock(domain.mutex);
+            //readers entering from here on load the new copy
+            uint64_t tag = domain.epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+            domain.garbage.push_back(Garbage(old, destroy, tag));
+            domain.newest.store(tag, std::memory_order_relaxed);
+        }
+        domain.Collect();
+    }
+
+    /**
+    *free every replaced copy no reader can hold anymore
+    */
+    void Collect()
+    {
+        std::vector<Garbage> ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            WriterFence();
+            uint64_t oldest = UINT64_MAX;
+            for (Record *r = records.load(std::memory_order_acquire); r; r = r->next)
+            {
+                uint64_t entered = r->epoch.load(std::memory_order_acquire);
+                if (entered && entered < oldest)
+                {
+                    oldest = entered;
+                }
+            }
+            uint64_t left = 0;
+            for (size_t i = 0; i < garbage.size();)
+            {
+                if (garbage[i].tag <= oldest)
+                {
+                    ready.push_back(garbage[i]);
+                    garbage[i] = garbage.back();
+                    garbage.pop_back();
+                }
+                else
+                {
+                    if (garbage[i].tag > left) left = garbage[i].tag;
+                    ++i;
+                }
+            }
+            newest.store(left, std::memory_order_relaxed);
+        }
+        //outside the lock, a destructor may update an RcuPtr itself
+        for (auto &g : ready)
+        {
+            g.destroy(g.old);
+        }
+    }
+
+    /**
+    *the domain lives for the whole process, static RcuPtrs and threads may
+    *still read while static objects are destroyed
+    */
+    static RcuDomain &Get()
+    {
+        static RcuDomain *domain = new RcuDomain();
+        return *domain;
+    }
+
+private:
+    struct Record
+    {
+        Record() : epoch(0), used(true), next(NULL) {}
+        char pad0[64];
+        std::atomic<uint64_t> epoch;
+        char pad1[64];
+        std::atomic<bool> used;
+        Record *next;
+    };
+
+    struct Garbage
+    {
+        Garbage(const void *old, void (*destroy)(const void *), uint64_t tag) : old(old), destroy(destroy), tag(tag) {}
+        const void *old;
+        void (*destroy)(const void *);
+        uint64_t tag;
+    };
+
+    //plain data so it can still be used after the thread locals are destroyed
+    struct ThreadState
+    {
+        Record *record;
+        size_t depth;
+        bool dead;
+    };
+
+    struct ThreadGuard
+    {
+        ~ThreadGuard()
+        {
+            ThreadState &state = State();
+            if (state.record && state.depth == 0)
+            {
+                Get().Release(state.record);
+                state.record = NULL;
+            }
+            state.dead = true;
+        }
+    };
+
+    RcuDomain() : epoch(1), newest(0), records(NULL), asymmetric(RegisterFence())
+    {
+    }
+
+    static bool RegisterFence()
+    {
+#if defined(_MSC_VER)
+        return true;
+#elif defined(__linux__) && defined(SYS_membarrier)
+        //MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED
+        return syscall(SYS_membarrier, 1 << 4, 0) == 0;
+#else
+        return false;
+#endif
+    }
+
+    void ReaderFence() const
+    {
+        if (asymmetric)
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+        else
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    //a full fence on every thread of the process that runs right now
+    void WriterFence() const
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (asymmetric)
+        {
+#if defined(_MSC_VER)
+            FlushProcessWriteBuffers();
+#elif defined(__linux__) && defined(SYS_membarrier)
+            //MEMBARRIER_CMD_PRIVATE_EXPEDITED
+            syscall(SYS_membarrier, 1 << 3, 0);
+#endif
+        }
+    }
+
+    static ThreadState &State()
+    {
+        static thread_local ThreadState state = { NULL, 0, false };
+        if (!state.record && !state.dead)
+        {
+            static thread_local ThreadGuard guard;
+            (void)guard;
+        }
+        return state;
+    }
+
+    //records are never freed, a thread that leaves gives its own to the next
+    Record *Acquire()
+    {
+        for (Record *r = records.load(std::memory_order_acquire); r; r = r->next)
+        {
+            bool used = false;
+            if (!r->used.load(std::memory_order_relaxed) && r->used.compare_exchange_strong(used, true, std::memory_order_acquire))
+            {
+                return r;
+            }
+        }
+        Record *r = new Record();
+        r->next = records.load(std::memory_order_relaxed);
+        while (!records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        return r;
+    }
+
+    void Release(Record *r)
+    {
+        r->used.store(false, std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> epoch;
+    //tag of the newest copy not freed yet, 0 when there is none
+    std::atomic<uint64_t> newest;
+    std::atomic<Record *> records;
+    std::mutex mutex;
+    std::vector<Garbage> garbage;
+    //readers fence with the compiler only, WriterFence fences them
+    const bool asymmetric;
+};
+
+/**
+*a read mostly value. readers pin the current copy without a lock or a shared
+*write, writers copy it, change the copy and publish it. a replaced copy is
+*freed by RcuDomain once no reader that may have seen it is left
+*/
+template <typename T>
+class RcuPtr
+{
+public:
+    /**
+    *keeps the copy it saw alive until it goes out of scope
+    */
+    class Reader
+    {
+    public:
+        explicit Reader(const RcuPtr &ptr) : entered(RcuDomain::Enter())
+        {
+            value = ptr.current.load(std::memory_order_acquire);
+        }
+        ~Reader()
+        {
+            RcuDomain::Leave(entered);
+        }
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+        const T &operator*() const { return *value; }
+        const T *operator->() const { return value; }
+
+    private:
+        uint64_t entered;
+        const T *value;
+    };
+
+public:
+    explicit RcuPtr(const T &value = T()) : current(new T(value))
+    {
+        //created first, the domain is still there when a static RcuPtr goes
+        RcuDomain::Get();
+    }
+    ~RcuPtr()
+    {
+        delete current.load(std::memory_order_relaxed);
+    }
+    RcuPtr(const RcuPtr &) = delete;
+    RcuPtr &operator=(const RcuPtr &) = delete;
+
+    /**
+    *change a copy of the value with f(T &) and publish it, writers run one at a time
+    */
+    template <typename F>
+    void Update(F f)
+    {
+        std::unique_lock<std::mutex> lock(writer);
+        T *next = new T(*current.load(std::memory_order_relaxed));
+        try
+        {
+            f(*next);
+        }
+        catch (...)
+        {
+            delete next;
+            throw;
+        }
+        T *old = current.exchange(next, std::memory_order_seq_cst);
+        //the destructors of freed copies may run here, without our lock
+        lock.unlock();
+        RcuDomain::Retire(old, &Destroy);
+    }
+
+private:
+    static void Destroy(const void *old)
+    {
+        delete static_cast<const T *>(old);
+    }
+
+    std::atomic<T *> current;
+    std::mutex writer;
+};
+
+#endif // !EVENT_RCU_PTR_H
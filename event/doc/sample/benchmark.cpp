@@ -0,0 +1,147 @@
+#if defined(_MSC_VER)
+#include <event\EventHub.h>
+#elif defined(__GNUC__)
+#include <event/EventHub.h>
+#else
+#error unsupported compiler
+#endif
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+//the dispatch path of the old EventHub: one mutex for everything, lookups with operator[]
+class LockedEventHub
+{
+public:
+    LockedEventHub() : pool(std::make_shared<ThreadPool>(2))
+    {
+    }
+
+    template <typename T>
+    std::shared_ptr<std::function<void(u_int, void *)>> SubscribeEvent(u_int event, const std::function<void(u_int, T *)> &f)
+    {
+        auto ptr = std::make_shared<std::function<void(u_int, void *)>>([f](u_int var1, void *var2)
+        {
+            f(var1, (T *)var2);
+        });
+        std::unique_lock<std::mutex> lock(obj_mutex);
+        listeners[event][typeid(T).hash_code()].emplace_back(ptr);
+        return ptr;
+    }
+
+    void UnSubscribeEvent(u_int event, size_t type_hash, const std::shared_ptr<std::function<void(u_int, void *)>> &id)
+    {
+        std::unique_lock<std::mutex> lock(obj_mutex);
+        auto &list = listeners[event][type_hash];
+        auto it = std::find(list.begin(), list.end(), id);
+        if (it != list.end()) list.erase(it);
+    }
+
+    template <typename T>
+    bool DispatchEvent(u_int event, T &&s)
+    {
+        typedef typename std::remove_reference<T>::type type;
+        auto ptr = std::make_shared<type>(std::forward<T>(s));
+        std::unique_lock<std::mutex> lock(obj_mutex);
+        for (auto f : listeners[event][typeid(type).hash_code()])
+        {
+            pool->enqueue([event, f, ptr] { (*f)(event, (void *)ptr.get()); });
+        }
+        for (auto f : listeners[event][typeid(void).hash_code()])
+        {
+            pool->enqueue([event, f, ptr] { (*f)(event, (void *)ptr.get()); });
+        }
+        return true;
+    }
+
+private:
+    std::mutex obj_mutex;
+    std::shared_ptr<ThreadPool> pool;
+    std::map<u_int, std::map<size_t, std::vector<std::shared_ptr<std::function<void(u_int, void *)>>>>> listeners;
+};
+
+std::atomic<size_t> handled(0);
+
+void on_event(u_int, int *)
+{
+    handled.fetch_add(1, std::memory_order_relaxed);
+}
+
+//dispatchers send events 1..16 while one thread keeps subscribing and
+//unsubscribing on event 0, only event 1 has a listener
+template <typename Hub, typename Churn>
+double Run(Hub &hub, size_t threads, size_t count, Churn churn)
+{
+    std::atomic<bool> stop(false);
+    std::thread churner([&]
+    {
+        while (!stop.load(std::memory_order_relaxed)) churn();
+    });
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> dispatchers;
+    for (size_t t = 0; t < threads; ++t)
+    {
+        dispatchers.emplace_back([&hub, count]
+        {
+            for (size_t i = 0; i < count; ++i) hub.DispatchEvent(u_int(1 + i % 16), int(i));
+        });
+    }
+    for (auto &t : dispatchers) t.join();
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+    stop = true;
+    churner.join();
+    return threads * count / used.count() / 1e6;
+}
+
+void on_value(const int &)
+{
+    handled.fetch_add(1, std::memory_order_relaxed);
+}
+
+//ns per dispatch to one inline listener on a single thread
+template <typename Dispatch>
+double InlineCost(size_t count, Dispatch dispatch)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) dispatch(int(i));
+    std::chrono::duration<double, std::nano> used = std::chrono::steady_clock::now() - start;
+    return used.count() / count;
+}
+
+int main()
+{
+    const size_t count = 200000;
+    size_t cores = std::thread::hardware_concurrency();
+    if (!cores) cores = 4;
+    std::cout << "dispatch threads  locked Mevents/s  snapshot Mevents/s" << std::endl;
+    for (size_t threads = 1; threads <= cores; threads *= 2)
+    {
+        LockedEventHub locked;
+        locked.SubscribeEvent<int>(1, on_event);
+        double a = Run(locked, threads, count, [&locked]
+        {
+            auto id = locked.SubscribeEvent<int>(0, on_event);
+            locked.UnSubscribeEvent(0, typeid(int).hash_code(), id);
+        });
+
+        EventHub hub(2);
+        hub.SubscribeEvent<int>(1, on_event);
+        double b = Run(hub, threads, count, [&hub]
+        {
+            hub.UnSubscribeEvent(0, hub.SubscribeEvent<int>(0, on_event));
+        });
+        std::cout << threads << "\t\t  " << a << "\t\t     " << b << std::endl;
+    }
+
+    EventHub hub(2);
+    hub.SubscribeEvent<int>(1, on_event, EventHub::Delivery::Inline);
+    EventChannel<int> &channel = hub.Channel<int>(2);
+    channel.Subscribe(on_value);
+    const size_t inline_count = 10000000;
+    double hub_ns = InlineCost(inline_count, [&hub](int i) { hub.DispatchEvent(1, i); });
+    double channel_ns = InlineCost(inline_count, [&channel](int i) { channel.Dispatch(i); });
+    std::cout << "inline dispatch  EventHub ns  EventChannel ns" << std::endl;
+    std::cout << "\t\t  " << hub_ns << "\t\t     " << channel_ns << std::endl;
+    return 0;
+}
@@ -23,7 +23,29 @@ PacketParser::~PacketParser()
 
 }
 
-std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt, size_t pktlen, bool eth_included)
+/* Where ParsePacketRaw gets its headers from */
+struct HeapHeaders
+{
+    template<typename T>
+    std::shared_ptr<T> New() const
+    {
+        return std::make_shared<T>();
+    }
+};
+
+struct ArenaHeaders
+{
+    MonotonicArena &arena;
+
+    template<typename T>
+    std::shared_ptr<T> New() const
+    {
+        return std::allocate_shared<T>(ArenaAllocator<T>(arena));
+    }
+};
+
+template<typename Headers>
+static std::shared_ptr<NetBase> ParseRaw(const unsigned char *pkt, size_t pktlen, bool eth_included, const Headers &headers)
 {
     const unsigned char*curr_pkt = pkt; /* Pointer to current part of the packet   */
     size_t curr_pktlen = pktlen;        /* Remaining packet length                 */
@@ -45,7 +67,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
     while (curr_pktlen > 0) {
         if (next_layer == LINK_LAYER) {
             if (expected == HEADER_TYPE_ETHERNET) {
-                std::shared_ptr<EthernetHeader> eth_header = std::make_shared<EthernetHeader>();
+                std::shared_ptr<EthernetHeader> eth_header = headers.template New<EthernetHeader>();
                 if (!eth_header) {
                     return head;
                 }
@@ -72,7 +94,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
                 next_header = eth_header;
             }
             else if (expected == HEADER_TYPE_ARP) {
-                std::shared_ptr<ArpHeader> arp_header = std::make_shared<ArpHeader>();
+                std::shared_ptr<ArpHeader> arp_header = headers.template New<ArpHeader>();
                 if (!arp_header) {
                     return head;
                 }
@@ -92,7 +114,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
             }
         }
         else if (next_layer == NETWORK_LAYER) {
-            std::shared_ptr<IPv4Header> ipv4_header = std::make_shared<IPv4Header>();
+            std::shared_ptr<IPv4Header> ipv4_header = headers.template New<IPv4Header>();
             if (!ipv4_header) {
                 return head;
             }
@@ -133,7 +155,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
         }
         else if (next_layer == TRANSPORT_LAYER) {
             if (expected == HEADER_TYPE_TCP) {
-                std::shared_ptr<TCPHeader> tcp_header = std::make_shared<TCPHeader>();
+                std::shared_ptr<TCPHeader> tcp_header = headers.template New<TCPHeader>();
                 if (!tcp_header) {
                     return head;
                 }
@@ -152,7 +174,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
                 next_header = tcp_header;
             }
             else if (expected == HEADER_TYPE_UDP) {
-                std::shared_ptr<UDPHeader> udp_header = std::make_shared<UDPHeader>();
+                std::shared_ptr<UDPHeader> udp_header = headers.template New<UDPHeader>();
                 if (!udp_header) {
                     return head;
                 }
@@ -166,7 +188,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
                 next_header = udp_header;
             }
             else if (expected == HEADER_TYPE_ICMPv4) {
-                std::shared_ptr<ICMPv4Header> icmpv4_header = std::make_shared<ICMPv4Header>();
+                std::shared_ptr<ICMPv4Header> icmpv4_header = headers.template New<ICMPv4Header>();
                 if (!icmpv4_header) {
                     return head;
                 }
@@ -209,7 +231,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
             * determine if this header is ARP by checking its size
             * and checking for some common values. */
 
-            std::shared_ptr<ArpHeader> arp_header = std::make_shared<ArpHeader>();
+            std::shared_ptr<ArpHeader> arp_header = headers.template New<ArpHeader>();
             if (!arp_header) {
                 return head;
             }
@@ -223,7 +245,7 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
                     next_header = arp_header;
             }
             else {
-                std::shared_ptr<RawData> raw_data = std::make_shared<RawData>();
+                std::shared_ptr<RawData> raw_data = headers.template New<RawData>();
                 if (!raw_data) {
                     return head;
                 }
@@ -249,6 +271,17 @@ std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt,
     return head;
 }
 
+std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt, size_t pktlen, bool eth_included)
+{
+    return ParseRaw(pkt, pktlen, eth_included, HeapHeaders());
+}
+
+std::shared_ptr<NetBase> PacketParser::ParsePacketRaw(const unsigned char *pkt, size_t pktlen, bool eth_included, MonotonicArena &arena)
+{
+    ArenaHeaders headers = { arena };
+    return ParseRaw(pkt, pktlen, eth_included, headers);
+}
+
 std::shared_ptr<NetBase> PacketParser::ParsePacketJson(const Json::Value &in)
 {
     std::shared_ptr<NetBase> head;
@@ -3,6 +3,14 @@
 
 #include "NetBase.h"
 
+#if defined(_MSC_VER)
+#include <arena\MonotonicArena.h>
+#elif defined(__GNUC__)
+#include <arena/MonotonicArena.h>
+#else
+#error unsupported compiler
+#endif
+
 class PacketParser
 {
 public:
@@ -15,6 +23,11 @@ public:
     */
     static std::shared_ptr<NetBase> ParsePacketRaw(const unsigned char *pkt, size_t pktlen, bool eth_included = false);
     /**
+    *same as above, but the headers and their reference counts are allocated in arena,
+    *the returned chain must be gone before the arena is released
+    */
+    static std::shared_ptr<NetBase> ParsePacketRaw(const unsigned char *pkt, size_t pktlen, bool eth_included, MonotonicArena &arena);
+    /**
     *unparse the packet which is show in json, it must be an json array
     *in(in): packet json data
     *return the head of the packet chain
@@ -99,9 +99,13 @@ bool TCPHeader::Validate() const
     return true;
 }
 
-void TCPHeader::SetSourcePort(unsigned short p)
+void TCPHeader::SetSourcePort(unsigned short p, bool adjust_sum)
 {
-    this->h.th_sport = htons(p);
+    unsigned short port = htons(p);
+    if (adjust_sum) {
+        this->h.th_sum = Checksum::Update16(this->h.th_sum, this->h.th_sport, port);
+    }
+    this->h.th_sport = port;
 }
 
 unsigned short TCPHeader::GetSourcePort() const
@@ -109,9 +113,13 @@ unsigned short TCPHeader::GetSourcePort() const
     return htons(this->h.th_sport);
 }
 
-void TCPHeader::SetDestinationPort(unsigned short p)
+void TCPHeader::SetDestinationPort(unsigned short p, bool adjust_sum)
 {
-    this->h.th_dport = htons(p);
+    unsigned short port = htons(p);
+    if (adjust_sum) {
+        this->h.th_sum = Checksum::Update16(this->h.th_sum, this->h.th_dport, port);
+    }
+    this->h.th_dport = port;
 }
 
 unsigned short TCPHeader::GetDestinationPort() const
@@ -119,9 +127,13 @@ unsigned short TCPHeader::GetDestinationPort() const
     return htons(this->h.th_dport);
 }
 
-void TCPHeader::SetSeq(unsigned int p)
+void TCPHeader::SetSeq(unsigned int p, bool adjust_sum)
 {
-    this->h.th_seq = htonl(p);
+    unsigned int seq = htonl(p);
+    if (adjust_sum) {
+        this->h.th_sum = Checksum::Update32(this->h.th_sum, this->h.th_seq, seq);
+    }
+    this->h.th_seq = seq;
 }
 
 unsigned int TCPHeader::GetSeq() const
@@ -129,9 +141,13 @@ unsigned int TCPHeader::GetSeq() const
     return htonl(this->h.th_seq);
 }
 
-void TCPHeader::SetAck(unsigned int p)
+void TCPHeader::SetAck(unsigned int p, bool adjust_sum)
 {
-    this->h.th_ack = htonl(p);
+    unsigned int ack = htonl(p);
+    if (adjust_sum) {
+        this->h.th_sum = Checksum::Update32(this->h.th_sum, this->h.th_ack, ack);
+    }
+    this->h.th_ack = ack;
 }
 
 unsigned int TCPHeader::GetAck() const
@@ -148,16 +148,18 @@ public:
     Json::Value Serialize() const;
     bool UnSerialize(const Json::Value &in);
 
-    void SetSourcePort(unsigned short p);
+    //adjust_sum: patch the checksum for the new value (RFC 1624) instead of
+    //summing the whole segment again with SetSum(), for reused probes
+    void SetSourcePort(unsigned short p, bool adjust_sum = false);
     unsigned short GetSourcePort() const;
 
-    void SetDestinationPort(unsigned short p);
+    void SetDestinationPort(unsigned short p, bool adjust_sum = false);
     unsigned short GetDestinationPort() const;
 
-    void SetSeq(unsigned int p);
+    void SetSeq(unsigned int p, bool adjust_sum = false);
     unsigned int GetSeq() const;
 
-    void SetAck(unsigned int p);
+    void SetAck(unsigned int p, bool adjust_sum = false);
     unsigned int GetAck() const;
 
     void SetHeaderLength();
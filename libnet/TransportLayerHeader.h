@@ -11,14 +11,14 @@ public:
     /* Returns source port. */
     virtual unsigned short GetSourcePort() const = 0;
 
-    /* Sets source port. */
-    virtual void SetSourcePort(unsigned short val) = 0;
+    /* Sets source port, adjust_sum patches the checksum for it instead of a new SetSum(). */
+    virtual void SetSourcePort(unsigned short val, bool adjust_sum = false) = 0;
 
     /* Returns destination port. */
     virtual unsigned short GetDestinationPort() const = 0;
 
-    /* Sets destination port. */
-    virtual void SetDestinationPort(unsigned short val) = 0;
+    /* Sets destination port, adjust_sum patches the checksum for it instead of a new SetSum(). */
+    virtual void SetDestinationPort(unsigned short val, bool adjust_sum = false) = 0;
 
     /* Sets checksum. */
     virtual void SetSum() = 0;
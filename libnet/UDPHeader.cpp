@@ -10,6 +10,16 @@
 #error unsupported compiler
 #endif
 
+//a zero sum means none was sent and stays so, a sum that comes to zero goes out as all ones (RFC 768)
+static unsigned short AdjustSum(unsigned short sum, unsigned short old_value, unsigned short new_value)
+{
+    if (!sum) {
+        return 0;
+    }
+    sum = Checksum::Update16(sum, old_value, new_value);
+    return sum ? sum : 0xFFFF;
+}
+
 UDPHeader::UDPHeader() : TransportLayerHeader()
 {
     this->Reset();
@@ -50,9 +60,13 @@ bool UDPHeader::StorePacket(const unsigned char *buf, size_t len)
     return true;
 }
 
-void UDPHeader::SetSourcePort(unsigned short p)
+void UDPHeader::SetSourcePort(unsigned short p, bool adjust_sum)
 {
-    this->h.uh_sport = htons(p);
+    unsigned short port = htons(p);
+    if (adjust_sum) {
+        this->h.uh_sum = AdjustSum(this->h.uh_sum, this->h.uh_sport, port);
+    }
+    this->h.uh_sport = port;
 }
 
 unsigned short UDPHeader::GetSourcePort() const
@@ -60,9 +74,13 @@ unsigned short UDPHeader::GetSourcePort() const
     return htons(this->h.uh_sport);
 }
 
-void UDPHeader::SetDestinationPort(unsigned short p)
+void UDPHeader::SetDestinationPort(unsigned short p, bool adjust_sum)
 {
-    this->h.uh_dport = htons(p);
+    unsigned short port = htons(p);
+    if (adjust_sum) {
+        this->h.uh_sum = AdjustSum(this->h.uh_sum, this->h.uh_dport, port);
+    }
+    this->h.uh_dport = port;
 }
 
 unsigned short UDPHeader::GetDestinationPort() const
@@ -44,10 +44,12 @@ public:
     Json::Value Serialize() const;
     bool UnSerialize(const Json::Value &in);
 
-    void SetSourcePort(unsigned short p);
+    //adjust_sum: patch the checksum for the new value (RFC 1624) instead of
+    //summing the whole datagram again with SetSum(), for reused probes
+    void SetSourcePort(unsigned short p, bool adjust_sum = false);
     unsigned short GetSourcePort() const;
 
-    void SetDestinationPort(unsigned short p);
+    void SetDestinationPort(unsigned short p, bool adjust_sum = false);
     unsigned short GetDestinationPort() const;
 
     void SetTotalLength();
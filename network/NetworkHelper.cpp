@@ -268,7 +268,8 @@ u_short NetworkHelper::ComputerTcpOUdpSum(const struct in_addr &src, const struc
         unsigned char proto;
         unsigned short length;
     } hdr;
-    int sum = 0;
+    uint64_t partial;
+    u_short sum;
 
     hdr.src = src;
     hdr.dst = dst;
@@ -277,11 +278,11 @@ u_short NetworkHelper::ComputerTcpOUdpSum(const struct in_addr &src, const struc
     hdr.length = htons(len);
 
     /* Get the ones'-complement sum of the pseudo-header. */
-    sum = AlgorithmHelper::CheckSumAdd((unsigned char *)&hdr, sizeof(hdr), sum);
+    partial = Checksum::Add(&hdr, sizeof(hdr));
     /* Add it to the sum of the packet. */
-    sum = AlgorithmHelper::CheckSumAdd((unsigned char *)buf, len, sum);
+    partial = Checksum::Add(buf, len, partial);
     /* Fold in the carry, take the complement, and return. */
-    sum = CKSUM_CARRY(sum);
+    sum = (u_short)~Checksum::Fold(partial);
     /* RFC 768: "If the computed  checksum  is zero,  it is transmitted  as all
     * ones (the equivalent  in one's complement  arithmetic).   An all zero
     * transmitted checksum  value means that the transmitter  generated  no
@@ -2,6 +2,13 @@
 #define RESOURCE_POOL_H_INCLUDED
 
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <type_traits>
 
 template<typename T>
 class Resource
@@ -38,24 +45,572 @@ public:
     Resource<T> *next;
 };
 
+/**
+*runs on every resource given back to a pool, so the next user gets it
+*clean. calls clear() when T has one, specialize it for other types
+*/
+template<typename T>
+struct ResourceReset
+{
+    static void Reset(T &data)
+    {
+        Clear(data, 0);
+    }
+
+private:
+    template<typename U>
+    static auto Clear(U &data, int) -> decltype(data.clear(), void())
+    {
+        data.clear();
+    }
+
+    template<typename U>
+    static void Clear(U&, long)
+    {
+    }
+};
+
+/**
+*counters of a ResourcePool, see ResourcePool::GetStats
+*/
+struct ResourcePoolStats
+{
+    ResourcePoolStats() : hits(0), misses(0), outstanding(0), idle(0), trimmed(0) {}
+
+    size_t hits;        //gets served by a free resource
+    size_t misses;      //gets that had to allocate
+    size_t outstanding; //handed out and not freed yet
+    size_t idle;        //free resources in the depot, thread caches not included
+    size_t trimmed;     //freed by trimming or by the idle limit
+};
+
+/**
+*shared part of a ResourcePool: a lock free stack of full magazines (batches
+*of free resources) and a stack of spare magazine headers. headers live in
+*chunks that are only freed with the depot, so a stale header read during a
+*pop is harmless, and every stack word carries a tag against ABA.
+*resources are built in slabs of slab_size slots, one allocation each. a
+*destroyed resource gives its slot back to its slab, and a slab left with no
+*resource is deleted, except for one kept for the next Create until the
+*next trim.
+*slabs holding resources never given back outlive the depot
+*/
+template<typename T>
+class ResourceDepot
+{
+public:
+    static const size_t magazine_size = 32;
+    static const size_t slab_size = 64;
+
+    ResourceDepot(size_t minIdle, size_t maxIdle, std::chrono::nanoseconds trimAfter)
+        : closed(false), gets(0), frees(0), misses(0), trimmed(0), minIdle(minIdle), maxIdle(maxIdle),
+        trimAfter(trimAfter.count()), idle(0), lowWater(0), lastTrim(Now()), full(0), empty(0), allocated(0),
+        partial(NULL), spare(NULL)
+    {
+        for (size_t i = 0; i < max_chunks; ++i) {
+            chunks[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    ~ResourceDepot()
+    {
+        Drain();
+        for (size_t i = 0; i < max_chunks; ++i) {
+            delete[] chunks[i].load(std::memory_order_relaxed);
+        }
+        //every slab left in the list still has resources handed out, those
+        //are leaked with their slabs rather than freed under their users
+        delete spare;
+    }
+
+    ResourceDepot(const ResourceDepot&) = delete;
+    ResourceDepot& operator = (const ResourceDepot&) = delete;
+
+    /**
+    *hand over a chain of count resources, false when it would pass the idle
+    *limit or no header is left. the caller keeps the chain then
+    */
+    bool Push(Resource<T> *items, size_t count)
+    {
+        //counted before it is visible so a pop never takes idle below zero
+        if (idle.fetch_add(count, std::memory_order_relaxed) + count > maxIdle) {
+            idle.fetch_sub(count, std::memory_order_relaxed);
+            trimmed.fetch_add(count, std::memory_order_relaxed);
+            return false;
+        }
+        if (!PushMagazine(items, count)) {
+            idle.fetch_sub(count, std::memory_order_relaxed);
+            return false;
+        }
+        TrimIfDue();
+        return true;
+    }
+
+    /**
+    *take a chain of resources, NULL when the depot is empty
+    */
+    Resource<T>* Pop(size_t &count)
+    {
+        Resource<T> *items = PopMagazine(count);
+        if (!items) {
+            return NULL;
+        }
+        size_t left = idle.fetch_sub(count, std::memory_order_relaxed) - count;
+        size_t low = lowWater.load(std::memory_order_relaxed);
+        while (left < low && !lowWater.compare_exchange_weak(low, left, std::memory_order_relaxed)) {
+        }
+        TrimIfDue();
+        return items;
+    }
+
+    /**
+    *free every resource in the depot
+    */
+    void Drain()
+    {
+        size_t count;
+        while (Resource<T> *items = PopMagazine(count)) {
+            idle.fetch_sub(count, std::memory_order_relaxed);
+            Destroy(items);
+        }
+    }
+
+    /**
+    *free idle resources down to minIdle. unless all is set only those that
+    *sat in the depot since the last trim go, that is the lowest idle count
+    *seen in between
+    */
+    void Trim(bool all)
+    {
+        std::unique_lock<std::mutex> lck(trimming, std::defer_lock);
+        if (all) {
+            lck.lock();
+        }
+        else if (!lck.try_lock()) {
+            return;
+        }
+        size_t current = idle.load(std::memory_order_relaxed);
+        size_t excess = current > minIdle ? current - minIdle : 0;
+        if (!all && lowWater.load(std::memory_order_relaxed) < excess) {
+            excess = lowWater.load(std::memory_order_relaxed);
+        }
+        size_t freed = 0;
+        while (freed < excess) {
+            size_t count;
+            Resource<T> *items = PopMagazine(count);
+            if (!items) {
+                break;
+            }
+            if (freed + count > excess) {
+                //would go below minIdle
+                PushMagazine(items, count);
+                break;
+            }
+            idle.fetch_sub(count, std::memory_order_relaxed);
+            Destroy(items);
+            freed += count;
+        }
+        trimmed.fetch_add(freed, std::memory_order_relaxed);
+        lowWater.store(idle.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        lastTrim.store(Now(), std::memory_order_relaxed);
+        std::unique_lock<std::mutex> slck(slabLock);
+        delete spare;
+        spare = NULL;
+    }
+
+    ResourcePoolStats GetStats() const
+    {
+        ResourcePoolStats stats;
+        size_t got = gets.load(std::memory_order_relaxed);
+        stats.misses = misses.load(std::memory_order_relaxed);
+        stats.hits = got > stats.misses ? got - stats.misses : 0;
+        size_t freed = frees.load(std::memory_order_relaxed);
+        stats.outstanding = got > freed ? got - freed : 0;
+        stats.idle = idle.load(std::memory_order_relaxed);
+        stats.trimmed = trimmed.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    /**
+    *a new resource in a free slot, the partly used slabs are filled before
+    *a new slab is taken
+    */
+    Resource<T>* Create()
+    {
+        Slot *slot;
+        {
+            std::unique_lock<std::mutex> lck(slabLock);
+            if (!partial) {
+                Slab *slab = spare ? spare : new Slab();
+                spare = NULL;
+                Link(slab);
+            }
+            Slab *slab = partial;
+            slot = slab->free;
+            slab->free = slot->next;
+            if (++slab->used == slab_size) {
+                Unlink(slab);
+            }
+        }
+        try {
+            return new (&slot->storage) Resource<T>();
+        }
+        catch (...) {
+            std::unique_lock<std::mutex> lck(slabLock);
+            FreeSlot(slot);
+            throw;
+        }
+    }
+
+    /**
+    *destroy a chain of resources and give their slots back
+    */
+    void Destroy(Resource<T> *items)
+    {
+        Slot *first = NULL;
+        while (items) {
+            Resource<T> *r = items;
+            items = items->next;
+            r->next = NULL;
+            r->~Resource<T>();
+            Slot *slot = reinterpret_cast<Slot*>(r);
+            slot->next = first;
+            first = slot;
+        }
+        if (!first) {
+            return;
+        }
+        std::unique_lock<std::mutex> lck(slabLock);
+        while (first) {
+            Slot *slot = first;
+            first = first->next;
+            FreeSlot(slot);
+        }
+    }
+
+    //set once the owning pool is gone, thread caches then free instead of returning
+    std::atomic<bool> closed;
+
+    //totals, thread caches add theirs when they trade a magazine
+    std::atomic<size_t> gets;
+    std::atomic<size_t> frees;
+    std::atomic<size_t> misses;
+    std::atomic<size_t> trimmed;
+
+private:
+    static const size_t chunk_size = 256;
+    static const size_t max_chunks = 1024;
+
+    struct Slab;
+
+    //the resource comes first, a Resource<T>* is also its Slot*
+    struct Slot
+    {
+        union
+        {
+            Slot *next;
+            typename std::aligned_storage<sizeof(Resource<T>), alignof(Resource<T>)>::type storage;
+        };
+        Slab *slab;
+    };
+
+    struct Slab
+    {
+        Slab() : free(NULL), used(0), prev(NULL), next(NULL)
+        {
+            for (size_t i = slab_size; i-- > 0;) {
+                slots[i].slab = this;
+                slots[i].next = free;
+                free = &slots[i];
+            }
+        }
+
+        Slot slots[slab_size];
+        Slot *free;
+        size_t used;
+        //in the list of slabs with free slots
+        Slab *prev;
+        Slab *next;
+    };
+
+    struct Magazine
+    {
+        Magazine() : items(NULL), count(0), next(0) {}
+        Resource<T> *items;
+        size_t count;
+        std::atomic<uint32_t> next;
+    };
+
+    bool PushMagazine(Resource<T> *items, size_t count)
+    {
+        uint32_t index;
+        if (!Pop(empty, index) && !NewHeader(index)) {
+            return false;
+        }
+        Magazine &m = Header(index);
+        m.items = items;
+        m.count = count;
+        Push(full, index);
+        return true;
+    }
+
+    Resource<T>* PopMagazine(size_t &count)
+    {
+        uint32_t index;
+        if (!Pop(full, index)) {
+            count = 0;
+            return NULL;
+        }
+        Magazine &m = Header(index);
+        Resource<T> *items = m.items;
+        count = m.count;
+        m.items = NULL;
+        Push(empty, index);
+        return items;
+    }
+
+    //the slab functions run under slabLock
+    void Link(Slab *slab)
+    {
+        slab->prev = NULL;
+        slab->next = partial;
+        if (partial) {
+            partial->prev = slab;
+        }
+        partial = slab;
+    }
+
+    void Unlink(Slab *slab)
+    {
+        if (slab->prev) {
+            slab->prev->next = slab->next;
+        }
+        else {
+            partial = slab->next;
+        }
+        if (slab->next) {
+            slab->next->prev = slab->prev;
+        }
+        slab->prev = slab->next = NULL;
+    }
+
+    //a slab that was full goes back to the list, an emptied one is deleted
+    //unless it can be the spare
+    void FreeSlot(Slot *slot)
+    {
+        Slab *slab = slot->slab;
+        slot->next = slab->free;
+        slab->free = slot;
+        if (slab->used-- == slab_size) {
+            Link(slab);
+        }
+        if (slab->used == 0) {
+            Unlink(slab);
+            if (spare) {
+                delete slab;
+            }
+            else {
+                spare = slab;
+            }
+        }
+    }
+
+    static long long Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void TrimIfDue()
+    {
+        if (trimAfter > 0 && Now() - lastTrim.load(std::memory_order_relaxed) >= trimAfter) {
+            Trim(false);
+        }
+    }
+
+    //stack word: index + 1 of the top header in the low half (0 when empty),
+    //a tag bumped on every change in the high half
+    void Push(std::atomic<uint64_t> &stack, uint32_t index)
+    {
+        uint64_t old = stack.load(std::memory_order_relaxed);
+        uint64_t word;
+        do {
+            Header(index).next.store((uint32_t)old, std::memory_order_relaxed);
+            word = (((old >> 32) + 1) << 32) | (index + 1);
+        } while (!stack.compare_exchange_weak(old, word, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool Pop(std::atomic<uint64_t> &stack, uint32_t &index)
+    {
+        uint64_t old = stack.load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t top = (uint32_t)old;
+            if (!top) {
+                return false;
+            }
+            uint64_t word = (((old >> 32) + 1) << 32) | Header(top - 1).next.load(std::memory_order_relaxed);
+            if (stack.compare_exchange_weak(old, word, std::memory_order_acquire, std::memory_order_acquire)) {
+                index = top - 1;
+                return true;
+            }
+        }
+    }
+
+    Magazine& Header(uint32_t index)
+    {
+        return chunks[index / chunk_size].load(std::memory_order_acquire)[index % chunk_size];
+    }
+
+    bool NewHeader(uint32_t &index)
+    {
+        std::unique_lock<std::mutex> lck(grow);
+        if (allocated == chunk_size * max_chunks) {
+            return false;
+        }
+        index = (uint32_t)allocated++;
+        if (index % chunk_size == 0) {
+            chunks[index / chunk_size].store(new Magazine[chunk_size], std::memory_order_release);
+        }
+        return true;
+    }
+
+    const size_t minIdle;
+    const size_t maxIdle;
+    const long long trimAfter;
+    std::atomic<size_t> idle;
+    std::atomic<size_t> lowWater;
+    std::atomic<long long> lastTrim;
+    std::mutex trimming;
+    char pad0[64];
+    std::atomic<uint64_t> full;
+    char pad1[64];
+    std::atomic<uint64_t> empty;
+    char pad2[64];
+    std::atomic<Magazine*> chunks[max_chunks];
+    size_t allocated;
+    std::mutex grow;
+    //slabs with both free and used slots, and one slab with no resource
+    Slab *partial;
+    Slab *spare;
+    std::mutex slabLock;
+};
+
+template<typename T>
+class ResourcePool;
+
+/**
+*owns one resource of a pool and gives it back when destroyed. the pool
+*must outlive it
+*/
+template<typename T>
+class PooledPtr
+{
+public:
+    PooledPtr() : pool(NULL), res(NULL)
+    {
+    }
+
+    PooledPtr(ResourcePool<T> *pool, Resource<T> *res) : pool(pool), res(res)
+    {
+    }
+
+    PooledPtr(PooledPtr &&other) : pool(other.pool), res(other.res)
+    {
+        other.pool = NULL;
+        other.res = NULL;
+    }
+
+    PooledPtr& operator = (PooledPtr &&other)
+    {
+        if (this != &other) {
+            Reset();
+            pool = other.pool;
+            res = other.res;
+            other.pool = NULL;
+            other.res = NULL;
+        }
+        return *this;
+    }
+
+    PooledPtr(const PooledPtr&) = delete;
+    PooledPtr& operator = (const PooledPtr&) = delete;
+
+    ~PooledPtr()
+    {
+        Reset();
+    }
+
+    T& operator * () const
+    {
+        return res->Get();
+    }
+
+    T* operator -> () const
+    {
+        return &res->Get();
+    }
+
+    T* Get() const
+    {
+        return res ? &res->Get() : NULL;
+    }
+
+    explicit operator bool() const
+    {
+        return res != NULL;
+    }
+
+    /**
+    *give the resource back now
+    */
+    void Reset()
+    {
+        if (res) {
+            pool->FreeResource(res);
+            res = NULL;
+        }
+    }
+
+    /**
+    *stop owning the resource, the caller frees it with FreeResource
+    */
+    Resource<T>* Release()
+    {
+        Resource<T> *r = res;
+        res = NULL;
+        return r;
+    }
+
+private:
+    ResourcePool<T> *pool;
+    Resource<T> *res;
+};
+
 template<typename T>
 class ResourcePool
 {
     /**
-    *all resource will not be free until pool free
+    *freed resources go to a per thread cache first and move to the shared
+    *depot a magazine at a time, so most calls touch nothing shared.
+    *the depot keeps at most maxIdle free resources, more are deleted when
+    *freed. with trimAfter set, every such period the resources that stayed
+    *idle all of it are deleted, down to minIdle. trimming runs on the calls
+    *that trade with the depot, a pool that goes quiet keeps what it has
+    *until Trim is called. every thread caches up to two magazines on top.
+    *the defaults keep everything until the pool is destroyed
     */
 public:
-    ResourcePool()
+    explicit ResourcePool(size_t minIdle = 0, size_t maxIdle = SIZE_MAX,
+        std::chrono::milliseconds trimAfter = std::chrono::milliseconds::zero())
+        : depot(std::make_shared< ResourceDepot<T> >(minIdle, maxIdle, trimAfter))
     {
-        free = NULL;
     }
 
     ~ResourcePool()
     {
-        if (free) {
-            delete free;
-            free = NULL;
-        }
+        //caches of live threads are freed by those threads
+        depot->closed = true;
+        depot->Drain();
     }
 
     ResourcePool(const ResourcePool&) = delete;
@@ -66,37 +621,251 @@ public:
     */
     Resource<T>* GetResource()
     {
-        if (!free) {
-            return new Resource<T>();
+        Cache *cache = Local();
+        if (!cache) {
+            depot->gets.fetch_add(1, std::memory_order_relaxed);
+            depot->misses.fetch_add(1, std::memory_order_relaxed);
+            return depot->Create();
         }
-        std::unique_lock<std::mutex> lck(lock);
-        Resource<T>* r = free;
-        free = free->next;
+        ++cache->gets;
+        if (!cache->count) {
+            Fold(*cache);
+            cache->items = depot->Pop(cache->count);
+            if (!cache->count) {
+                depot->misses.fetch_add(1, std::memory_order_relaxed);
+                return depot->Create();
+            }
+        }
+        Resource<T>* r = cache->items;
+        cache->items = r->next;
         r->next = NULL;
+        --cache->count;
         return r;
     }
 
     /**
-    *free a resource
+    *retrive a resource that frees itself
+    */
+    PooledPtr<T> Acquire()
+    {
+        return PooledPtr<T>(this, GetResource());
+    }
+
+    /**
+    *put n new resources in the depot, so a start up burst does not allocate.
+    *they go after one trim period unless minIdle covers them
+    */
+    void Reserve(size_t n)
+    {
+        while (n) {
+            size_t count = n < ResourceDepot<T>::magazine_size ? n : ResourceDepot<T>::magazine_size;
+            Resource<T> *items = NULL;
+            for (size_t i = 0; i < count; ++i) {
+                Resource<T> *r = depot->Create();
+                r->next = items;
+                items = r;
+            }
+            if (!depot->Push(items, count)) {
+                depot->Destroy(items);
+                return;
+            }
+            n -= count;
+        }
+    }
+
+    /**
+    *delete the idle resources of the depot down to minIdle right away
+    */
+    void Trim()
+    {
+        Cache *cache = Local();
+        if (cache) {
+            Release(*cache);
+        }
+        depot->Trim(true);
+    }
+
+    /**
+    *counters for sizing the pool. other threads add theirs when they next
+    *trade a magazine with the depot, so they lag by up to two magazines of
+    *calls per thread
+    */
+    ResourcePoolStats GetStats()
+    {
+        Cache *cache = Local();
+        if (cache) {
+            Fold(*cache);
+        }
+        return depot->GetStats();
+    }
+
+    /**
+    *free a resource, or a chain of them linked through next. each one is
+    *reset with ResourceReset<T>
     */
     void FreeResource(Resource<T>* res)
     {
         if (!res) {
             return;
         }
-        std::unique_lock<std::mutex> lck(lock);
-        Resource<T> *head = free;
-        free = res;
-        Resource<T> **next = &free->next;
-        while (*next) {
-            next = &((*next)->next);
+        Cache *cache = Local();
+        if (!cache) {
+            //thread is exiting, straight to the depot
+            Cache chain;
+            chain.depot = depot;
+            chain.items = res;
+            for (; res; res = res->next) {
+                ResourceReset<T>::Reset(res->Get());
+                ++chain.count;
+            }
+            chain.frees = chain.count;
+            Release(chain);
+            return;
+        }
+        while (res) {
+            Resource<T> *next = res->next;
+            ResourceReset<T>::Reset(res->Get());
+            res->next = cache->items;
+            cache->items = res;
+            ++cache->frees;
+            if (++cache->count == 2 * ResourceDepot<T>::magazine_size) {
+                Flush(*cache);
+            }
+            res = next;
         }
-        *next = head;
     }
 
 private:
-    std::mutex lock;
-    Resource<T> *free;
+    struct Cache
+    {
+        Cache() : items(NULL), count(0), gets(0), frees(0) {}
+        std::shared_ptr< ResourceDepot<T> > depot;
+        Resource<T> *items;
+        size_t count;
+        //not yet added to the depot totals
+        size_t gets;
+        size_t frees;
+    };
+
+    //the caches of one thread, one per pool it has used
+    struct ThreadCaches
+    {
+        ThreadCaches() : last(0) {}
+        ~ThreadCaches()
+        {
+            for (size_t i = 0; i < caches.size(); ++i) {
+                Release(caches[i]);
+            }
+        }
+        std::vector<Cache> caches;
+        size_t last;
+    };
+
+    //plain data so it can still be read after the thread locals are destroyed,
+    //pools with static storage (BigInt) are used from static destructors
+    struct ThreadState
+    {
+        ThreadCaches *caches;
+        bool dead;
+    };
+
+    struct ThreadGuard
+    {
+        ~ThreadGuard()
+        {
+            ThreadState &state = State();
+            delete state.caches;
+            state.caches = NULL;
+            state.dead = true;
+        }
+    };
+
+    static ThreadState& State()
+    {
+        static thread_local ThreadState state = { NULL, false };
+        return state;
+    }
+
+    //NULL once the thread is past its thread local destructors
+    Cache* Local()
+    {
+        ThreadState &state = State();
+        if (!state.caches) {
+            if (state.dead) {
+                return NULL;
+            }
+            static thread_local ThreadGuard guard;
+            (void)guard;
+            state.caches = new ThreadCaches();
+        }
+        ThreadCaches &local = *state.caches;
+        std::vector<Cache> &caches = local.caches;
+        if (local.last < caches.size() && caches[local.last].depot == depot) {
+            return &caches[local.last];
+        }
+        for (size_t i = 0; i < caches.size(); ++i) {
+            if (caches[i].depot == depot) {
+                local.last = i;
+                return &caches[i];
+            }
+        }
+        //forget pools that are gone while we are here
+        for (size_t i = 0; i < caches.size();) {
+            if (caches[i].depot->closed) {
+                Release(caches[i]);
+                caches[i] = caches.back();
+                caches.pop_back();
+            }
+            else {
+                ++i;
+            }
+        }
+        caches.push_back(Cache());
+        caches.back().depot = depot;
+        local.last = caches.size() - 1;
+        return &caches.back();
+    }
+
+    static void Fold(Cache &cache)
+    {
+        if (cache.gets) {
+            cache.depot->gets.fetch_add(cache.gets, std::memory_order_relaxed);
+            cache.gets = 0;
+        }
+        if (cache.frees) {
+            cache.depot->frees.fetch_add(cache.frees, std::memory_order_relaxed);
+            cache.frees = 0;
+        }
+    }
+
+    //keep one magazine, hand the other to the depot
+    static void Flush(Cache &cache)
+    {
+        Fold(cache);
+        Resource<T> *items = cache.items;
+        Resource<T> *last = items;
+        for (size_t i = 1; i < ResourceDepot<T>::magazine_size; ++i) {
+            last = last->next;
+        }
+        cache.items = last->next;
+        last->next = NULL;
+        cache.count -= ResourceDepot<T>::magazine_size;
+        if (!cache.depot->Push(items, ResourceDepot<T>::magazine_size)) {
+            cache.depot->Destroy(items);
+        }
+    }
+
+    static void Release(Cache &cache)
+    {
+        Fold(cache);
+        if (cache.items && (cache.depot->closed || !cache.depot->Push(cache.items, cache.count))) {
+            cache.depot->Destroy(cache.items);
+        }
+        cache.items = NULL;
+        cache.count = 0;
+    }
+
+    std::shared_ptr< ResourceDepot<T> > depot;
 };
 
 #endif
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <string>
+
+#include "ResourcePool.h"
+
+// the old pool: one mutex around a single free list
+template<typename T>
+class LockedResourcePool
+{
+public:
+    LockedResourcePool() : free(NULL) {}
+    ~LockedResourcePool() { delete free; }
+
+    Resource<T>* GetResource()
+    {
+        std::unique_lock<std::mutex> lck(lock);
+        if (!free) {
+            return new Resource<T>();
+        }
+        Resource<T>* r = free;
+        free = free->next;
+        r->next = NULL;
+        return r;
+    }
+
+    void FreeResource(Resource<T>* res)
+    {
+        std::unique_lock<std::mutex> lck(lock);
+        Resource<T> *head = free;
+        free = res;
+        Resource<T> **next = &free->next;
+        while (*next) {
+            next = &((*next)->next);
+        }
+        *next = head;
+    }
+
+private:
+    std::mutex lock;
+    Resource<T> *free;
+};
+
+// every thread takes a few buffers and gives them back, what BigInt does
+// for each temporary
+template<typename Pool>
+static double run(size_t threads, size_t rounds)
+{
+    Pool pool;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&pool, rounds] {
+            Resource< std::vector<unsigned> > *held[8];
+            for (size_t i = 0; i < rounds; ++i) {
+                for (size_t j = 0; j < 8; ++j) {
+                    held[j] = pool.GetResource();
+                    held[j]->Get().push_back((unsigned)i);
+                }
+                for (size_t j = 0; j < 8; ++j) {
+                    held[j]->Get().clear();
+                    pool.FreeResource(held[j]);
+                }
+            }
+        }));
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+    return threads * rounds * 8 / used.count() / 1e6;
+}
+
+int main()
+{
+    const size_t rounds = 200000;
+    size_t cores = std::thread::hardware_concurrency();
+    if (!cores) {
+        cores = 4;
+    }
+    std::cout << "threads  locked Mops/s  lock free Mops/s" << std::endl;
+    for (size_t threads = 1; threads <= 2 * cores; threads *= 2) {
+        double locked = run< LockedResourcePool< std::vector<unsigned> > >(threads, rounds);
+        double cached = run< ResourcePool< std::vector<unsigned> > >(threads, rounds);
+        std::cout << threads << "\t " << locked << "\t\t  " << cached << std::endl;
+    }
+    return 0;
+}
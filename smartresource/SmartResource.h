@@ -4,9 +4,13 @@
 /**
 SmartResource is used to load the resource that just need success load once. it just need to inherit the Resourc class, and realize the
 LoadResource and UnloadResource interface, then use SmartResource class to manage the resource.
+a resource that is already loaded is taken and released with an atomic counter only, the mutex is held only to load and unload it,
+so LoadResource runs once however many threads ask at the same time. SmartResource::PreloadAsync loads it in the background ahead of use.
 */
 
 #include <mutex>
+#include <atomic>
+#include <future>
 
 class SmartResource;
 
@@ -15,7 +19,7 @@ class Resource
 friend class SmartResource;
 
 public:
-    Resource() : res_mutex(), res_ref_count(0), is_res_load(false){}
+    Resource() : res_mutex(), res_state(0){}
     ~Resource(){}
 
     Resource(const Resource&) = delete;
@@ -24,7 +28,7 @@ public:
     Resource& operator=(Resource&&) = delete;
 
 protected:
-    virtual bool LoadResource() 
+    virtual bool LoadResource()
     {
         return true;
     }
@@ -34,9 +38,11 @@ protected:
     }
 
 private:
-    std::mutex    res_mutex;
-    unsigned int  res_ref_count;
-    bool          is_res_load;
+    static const unsigned int loaded = 1;
+    static const unsigned int holder = 2;
+
+    std::mutex                 res_mutex;  //load and unload lock
+    std::atomic<unsigned int>  res_state;  //holder count * holder | loaded, one word so a holder never joins a resource being unloaded
 };
 
 class SmartResource
@@ -44,30 +50,46 @@ class SmartResource
 public:
     SmartResource(Resource &res) : m_res(res)
     {
-        std::unique_lock<std::mutex> lck(m_res.res_mutex);
-        if (m_res.res_ref_count++ && m_res.is_res_load)
-        {
-            return;
-        }
-        m_res.is_res_load = true;
-        try
+        //loaded: join without the lock
+        unsigned int state = m_res.res_state.load(std::memory_order_acquire);
+        while (state & Resource::loaded)
         {
-            if (!m_res.LoadResource())
+            if (m_res.res_state.compare_exchange_weak(state, state + Resource::holder, std::memory_order_acquire))
             {
-                m_res.is_res_load = false;
+                return;
             }
         }
-        catch (...)
-        {
-            m_res.is_res_load = false;
-        }
+        std::unique_lock<std::mutex> lck(m_res.res_mutex);
+        m_res.res_state.fetch_add(Resource::holder, std::memory_order_acquire);
+        Load(m_res);
     }
     ~SmartResource()
     {
+        //not the last holder: leave without the lock
+        unsigned int state = m_res.res_state.load(std::memory_order_relaxed);
+        while (state >= 2 * Resource::holder)
+        {
+            if (m_res.res_state.compare_exchange_weak(state, state - Resource::holder, std::memory_order_release))
+            {
+                return;
+            }
+        }
         std::unique_lock<std::mutex> lck(m_res.res_mutex);
-        if (--m_res.res_ref_count || !m_res.is_res_load)
+        state = m_res.res_state.load(std::memory_order_relaxed);
+        for (;;)
         {
-            return;
+            if (state == (Resource::holder | Resource::loaded))
+            {
+                //the loaded bit goes with the last holder, a new one now waits on the lock
+                if (m_res.res_state.compare_exchange_weak(state, 0, std::memory_order_acq_rel))
+                {
+                    break;
+                }
+            }
+            else if (m_res.res_state.compare_exchange_weak(state, state - Resource::holder, std::memory_order_release))
+            {
+                return;
+            }
         }
         try
         {
@@ -77,7 +99,6 @@ public:
         {
 
         }
-        m_res.is_res_load = false;
     }
 
     SmartResource(const SmartResource&) = delete;
@@ -85,7 +106,55 @@ public:
     SmartResource& operator=(const SmartResource&) = delete;
     SmartResource& operator=(SmartResource&&) = delete;
 
+    /**
+    *whether the resource loaded, a failed load is tried again by the next SmartResource
+    */
+    bool IsLoaded() const
+    {
+        return (m_res.res_state.load(std::memory_order_acquire) & Resource::loaded) != 0;
+    }
+
+    /**
+    *load res now without holding it, it stays loaded until the last SmartResource after this goes
+    *return whether it is loaded
+    */
+    static bool Preload(Resource &res)
+    {
+        std::unique_lock<std::mutex> lck(res.res_mutex);
+        return Load(res);
+    }
+
+    /**
+    *Preload on a thread of its own, for resources that take long to load, res must outlive the future
+    */
+    static std::future<bool> PreloadAsync(Resource &res)
+    {
+        return std::async(std::launch::async, [&res] { return Preload(res); });
+    }
+
 private:
+    //called with res_mutex held
+    static bool Load(Resource &res)
+    {
+        if (res.res_state.load(std::memory_order_relaxed) & Resource::loaded)
+        {
+            return true;
+        }
+        try
+        {
+            if (!res.LoadResource())
+            {
+                return false;
+            }
+        }
+        catch (...)
+        {
+            return false;
+        }
+        res.res_state.fetch_or(Resource::loaded, std::memory_order_release);
+        return true;
+    }
+
     Resource &m_res;
 };
 
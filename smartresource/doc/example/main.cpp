@@ -32,6 +32,13 @@ int main()
     {
         SmartResource res(test);
     }
+    //load in the background while other work goes on
+    std::future<bool> preload = SmartResource::PreloadAsync(test);
+    std::cout << "preload " << preload.get() << std::endl;
+    {
+        SmartResource res(test);
+        std::cout << "loaded " << res.IsLoaded() << std::endl;
+    }
     return 0;
 }
 
@@ -3,8 +3,10 @@
 #include <cctype>
 #if defined(_MSC_VER)
 #include <windows.h>
+#include <template\table.h>
 #elif defined(__GNUC__)
 #include <iconv.h> 
+#include <template/table.h>
 #else
 #error unsupported compiler
 #endif
@@ -844,10 +846,13 @@ bool StringHelper::hex2byte(const std::string& hex, char *out, const size_t &out
     if (hex.empty()) return true;
     if (len & 0X01) return false;
     if ((len >> 1) > out_size) return false;
+    const stdex::table<unsigned char, 256> &hex_value = stdex::static_table<unsigned char, 256, stdex::hex_value_gen>::value;
     for (size_t pos = 0; pos < len; pos += 2)
     {
-        if (!isxdigit(hex[pos]) || !isxdigit(hex[pos + 1])) return false;
-        out[pos >> 1] = (HEX_STR_TO_NUM(hex[pos]) << 4) | HEX_STR_TO_NUM(hex[pos + 1]);
+        unsigned char high = hex_value[(unsigned char)hex[pos]];
+        unsigned char low = hex_value[(unsigned char)hex[pos + 1]];
+        if (high > 0X0F || low > 0X0F) return false;
+        out[pos >> 1] = (high << 4) | low;
     }
     return true;
 }
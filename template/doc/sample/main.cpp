@@ -0,0 +1,52 @@
+#if defined(_MSC_VER)
+#include <template\select.h>
+#include <template\table.h>
+#include <template\perfect_hash.h>
+#include <template\typelist.h>
+#elif defined(__GNUC__)
+#include <template/select.h>
+#include <template/table.h>
+#include <template/perfect_hash.h>
+#include <template/typelist.h>
+#else
+#error unsupported compiler
+#endif
+#include <iostream>
+#include <type_traits>
+
+//tables checked while compiling
+static_assert(stdex::static_table<uint32_t, 256, stdex::crc32_gen<0xEDB88320>>::value[1] == 0x77073096, "crc32 table");
+static_assert(stdex::static_table<unsigned char, 256, stdex::aes_sbox_gen>::value[0x53] == 0xED, "aes s-box");
+static_assert(stdex::select<int, 1, 2, 5, 3>::value == 5, "select");
+
+typedef stdex::typelist<char, short, int> ints;
+static_assert(stdex::index_of<ints, int>::value == 2, "index_of");
+static_assert(std::is_same<stdex::type_at<ints, 1>::type, short>::value, "type_at");
+
+enum class Proto { tcp, udp, icmp, arp };
+
+static constexpr stdex::string_entry<Proto> proto_names[] = {
+    { "tcp", Proto::tcp }, { "udp", Proto::udp }, { "icmp", Proto::icmp }, { "arp", Proto::arp }
+};
+static constexpr stdex::string_map<Proto, 4> protos(proto_names);
+
+int main()
+{
+    const char *names[] = { "udp", "arp", "ftp" };
+    for (auto name : names)
+    {
+        Proto proto;
+        if (protos.find(name, proto))
+        {
+            std::cout << name << " is " << static_cast<int>(proto) << std::endl;
+        }
+        else
+        {
+            std::cout << name << " is unknown" << std::endl;
+        }
+    }
+
+    const stdex::table<unsigned char, 256> &hex = stdex::static_table<unsigned char, 256, stdex::hex_value_gen>::value;
+    std::cout << "hex c is " << static_cast<int>(hex['c']) << std::endl;
+    return 0;
+}
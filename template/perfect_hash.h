@@ -0,0 +1,162 @@
+#ifndef PERFECT_HASH_H_INCLUDED
+#define PERFECT_HASH_H_INCLUDED
+
+#if defined(_MSC_VER)
+#include <template\table.h>
+#elif defined(__GNUC__)
+#include <template/table.h>
+#else
+#error unsupported compiler
+#endif
+#include <cstring>
+#include <string>
+#include <stdexcept>
+
+namespace stdex
+{
+    /*
+    string to value map with a perfect hash found by the compiler: a lookup
+    is one hash, one slot and one compare, no probing and no allocation.
+    meant for the small fixed maps of names to enums:
+    static constexpr string_entry<proto> names[] = { { "tcp", proto::tcp }, { "udp", proto::udp } };
+    static constexpr string_map<proto, 2> map(names);
+    proto p;
+    if (map.find("udp", p)) ...
+    the entries must have static storage, the map keeps a pointer to them.
+    the compiler tries seeds until no two keys share a slot, with the default
+    of about N * N / 2 slots one in three seeds works
+    */
+
+    template <typename E>
+    struct string_entry
+    {
+        const char *key;
+        E value;
+    };
+
+    namespace detail
+    {
+        constexpr size_t next_pow2(size_t n, size_t p = 1)
+        {
+            return p >= n ? p : next_pow2(n, p << 1);
+        }
+
+        constexpr size_t length(const char *s, size_t n = 0)
+        {
+            return s[n] ? length(s, n + 1) : n;
+        }
+
+        //seeded FNV-1a with a final mix, so the low bits used for the slot depend on all of them
+        constexpr uint32_t mix(uint32_t h)
+        {
+            return h ^ (h >> 15) ^ (h >> 7);
+        }
+
+        constexpr uint32_t fnv1a(const char *s, size_t len, uint32_t h)
+        {
+            return len == 0 ? h : fnv1a(s + 1, len - 1, (h ^ static_cast<unsigned char>(*s)) * 16777619u);
+        }
+
+        constexpr uint32_t hash(const char *s, size_t len, uint32_t seed)
+        {
+            return mix(fnv1a(s, len, 2166136261u ^ (seed * 0x9E3779B9u)));
+        }
+
+        inline uint32_t runtime_hash(const char *s, size_t len, uint32_t seed)
+        {
+            uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+            for (size_t i = 0; i < len; ++i) {
+                h = (h ^ static_cast<unsigned char>(s[i])) * 16777619u;
+            }
+            return mix(h);
+        }
+    }
+
+    template <typename E, size_t N, size_t M = detail::next_pow2(N * N / 2 > 8 ? N * N / 2 : 8)>
+    class string_map
+    {
+        static_assert(N > 0 && N < 255, "string_map holds 1 to 254 entries");
+        static_assert(M >= N && (M & (M - 1)) == 0, "string_map slots must be a power of two not below N");
+
+    public:
+        constexpr explicit string_map(const string_entry<E>(&entries)[N]) : string_map(entries, find_seed(entries, 0))
+        {
+        }
+
+        /**
+        *look up the key s of len bytes, value is set when found
+        */
+        bool find(const char *s, size_t len, E &value) const
+        {
+            size_t index = slots[detail::runtime_hash(s, len, seed) & (M - 1)];
+            if (index == N || std::strlen(entries[index].key) != len || std::memcmp(entries[index].key, s, len) != 0) {
+                return false;
+            }
+            value = entries[index].value;
+            return true;
+        }
+
+        bool find(const std::string &s, E &value) const
+        {
+            return find(s.data(), s.size(), value);
+        }
+
+        constexpr size_t size() const { return N; }
+
+    private:
+        constexpr string_map(const string_entry<E> *entries, uint32_t seed)
+            : entries(entries), seed(seed), slots(make_table<unsigned char, M>(slot_gen{ entries, seed }))
+        {
+        }
+
+        static constexpr size_t slot(const char *key, uint32_t seed)
+        {
+            return detail::hash(key, detail::length(key), seed) & (M - 1);
+        }
+
+        static constexpr bool unique_from(const string_entry<E> *entries, uint32_t seed, size_t i, size_t j)
+        {
+            return j >= N ? true : slot(entries[i].key, seed) == slot(entries[j].key, seed) ? false : unique_from(entries, seed, i, j + 1);
+        }
+
+        static constexpr bool perfect(const string_entry<E> *entries, uint32_t seed, size_t i)
+        {
+            return i >= N ? true : unique_from(entries, seed, i, i + 1) && perfect(entries, seed, i + 1);
+        }
+
+        static constexpr uint32_t find_seed(const string_entry<E> *entries, uint32_t seed)
+        {
+            return seed >= 256 ? throw std::logic_error("string_map found no perfect hash, give it more slots") :
+                perfect(entries, seed, 0) ? seed : find_seed(entries, seed + 1);
+        }
+
+        //the entry index in a slot, N for none
+        struct slot_gen
+        {
+            constexpr unsigned char operator()(size_t k) const
+            {
+                return search(k, 0);
+            }
+
+            constexpr unsigned char search(size_t k, size_t i) const
+            {
+                return i >= N ? static_cast<unsigned char>(N) : slot(entries[i].key, seed) == k ? static_cast<unsigned char>(i) : search(k, i + 1);
+            }
+
+            const string_entry<E> *entries;
+            uint32_t seed;
+        };
+
+        const string_entry<E> *entries;
+        uint32_t seed;
+        table<unsigned char, M> slots;
+    };
+
+    template <typename E, size_t N>
+    constexpr string_map<E, N> make_string_map(const string_entry<E>(&entries)[N])
+    {
+        return string_map<E, N>(entries);
+    }
+}
+
+#endif
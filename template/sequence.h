@@ -0,0 +1,44 @@
+#ifndef SEQUENCE_H_INCLUDED
+#define SEQUENCE_H_INCLUDED
+
+#include <cstddef>
+
+namespace stdex
+{
+    /*
+    compile time list of indexes, the C++11 stand-in for std::index_sequence:
+    make_index_sequence<3>::type is index_sequence<0, 1, 2>
+    */
+
+    template <size_t... I>
+    struct index_sequence
+    {
+        typedef index_sequence type;
+        static constexpr size_t size() { return sizeof...(I); }
+    };
+
+    template <typename A, typename B>
+    struct concat_sequence;
+
+    template <size_t... A, size_t... B>
+    struct concat_sequence<index_sequence<A...>, index_sequence<B...>> : index_sequence<A..., (sizeof...(A) + B)...>
+    {
+    };
+
+    template <size_t N>
+    struct make_index_sequence : concat_sequence<typename make_index_sequence<N / 2>::type, typename make_index_sequence<N - N / 2>::type>
+    {//split in halves, so the instantiation depth is log(N)
+    };
+
+    template <>
+    struct make_index_sequence<0> : index_sequence<>
+    {
+    };
+
+    template <>
+    struct make_index_sequence<1> : index_sequence<0>
+    {
+    };
+}
+
+#endif
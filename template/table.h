@@ -0,0 +1,227 @@
+#ifndef TABLE_H_INCLUDED
+#define TABLE_H_INCLUDED
+
+#if defined(_MSC_VER)
+#include <template\sequence.h>
+#elif defined(__GNUC__)
+#include <template/sequence.h>
+#else
+#error unsupported compiler
+#endif
+#include <cstdint>
+
+namespace stdex
+{
+    /*
+    lookup tables filled in by the compiler. a generator is a literal type
+    with a constexpr operator()(size_t index) giving the entry at index:
+    constexpr table<uint32_t, 256> t = make_table<uint32_t, 256>(crc32_gen<0xEDB88320>());
+    static_table<T, N, Gen>::value is one shared copy of such a table, it is
+    constant initialized, so reading it needs no init flag and no lock
+    */
+
+    template <typename T, size_t N>
+    struct table
+    {
+        constexpr const T &operator[](size_t index) const { return data[index]; }
+        constexpr size_t size() const { return N; }
+        const T *begin() const { return data; }
+        const T *end() const { return data + N; }
+
+        T data[N];
+    };
+
+    namespace detail
+    {
+        template <typename T, size_t N, typename Gen, size_t... I>
+        constexpr table<T, N> make_table(const Gen &gen, index_sequence<I...>)
+        {
+            return table<T, N>{ { static_cast<T>(gen(I))... } };
+        }
+    }
+
+    template <typename T, size_t N, typename Gen>
+    constexpr table<T, N> make_table(const Gen &gen)
+    {
+        return detail::make_table<T, N>(gen, typename make_index_sequence<N>::type());
+    }
+
+    template <typename T, size_t N, typename Gen>
+    struct static_table
+    {
+        static constexpr table<T, N> value = make_table<T, N>(Gen());
+    };
+
+    template <typename T, size_t N, typename Gen>
+    constexpr table<T, N> static_table<T, N, Gen>::value;
+
+    /*
+    reflected CRC32 of the byte index, Poly is the reversed polynomial:
+    0xEDB88320 for CRC32 (zlib), 0x82F63B78 for CRC32C (Castagnoli)
+    */
+    template <uint32_t Poly>
+    struct crc32_gen
+    {
+        constexpr uint32_t operator()(size_t index) const
+        {
+            return step(static_cast<uint32_t>(index), 8);
+        }
+
+        static constexpr uint32_t step(uint32_t crc, int bits)
+        {
+            return bits == 0 ? crc : step((crc & 1) ? Poly ^ (crc >> 1) : crc >> 1, bits - 1);
+        }
+    };
+
+    /*
+    table K of a slicing by N kernel: the CRC of the byte index followed by K
+    zero bytes, K = 0 is the plain table
+    */
+    template <uint32_t Poly, size_t K>
+    struct crc32_slice_gen
+    {
+        constexpr uint32_t operator()(size_t index) const
+        {
+            return shift(crc32_slice_gen<Poly, K - 1>()(index));
+        }
+
+        static constexpr uint32_t shift(uint32_t crc)
+        {
+            return crc32_gen<Poly>::step(crc & 0xff, 8) ^ (crc >> 8);
+        }
+    };
+
+    template <uint32_t Poly>
+    struct crc32_slice_gen<Poly, 0> : crc32_gen<Poly>
+    {
+    };
+
+    /*
+    polynomials modulo Poly in the reflected order of the CRC, x^0 is the top
+    bit. entry n of the table is x^(2^n), what combining CRCs of chunks needs
+    */
+    template <uint32_t Poly>
+    struct crc32_x2n_gen
+    {
+        constexpr uint32_t operator()(size_t n) const
+        {
+            return n == 0 ? 0x40000000u : square(operator()(n - 1));
+        }
+
+        static constexpr uint32_t square(uint32_t a)
+        {
+            return mul(a, a);
+        }
+
+        //a * b modulo Poly
+        static constexpr uint32_t mul(uint32_t a, uint32_t b, uint32_t bit = 0x80000000u, uint32_t product = 0)
+        {
+            return bit == 0 ? product : mul(a, (b & 1) ? (b >> 1) ^ Poly : b >> 1, bit >> 1, (a & bit) ? product ^ b : product);
+        }
+    };
+
+    /*
+    the byte index with its bits in reverse order
+    */
+    struct bit_reverse_gen
+    {
+        constexpr unsigned char operator()(size_t index) const
+        {
+            return static_cast<unsigned char>(((index & 0x01) << 7) | ((index & 0x02) << 5) | ((index & 0x04) << 3) | ((index & 0x08) << 1) |
+                ((index & 0x10) >> 1) | ((index & 0x20) >> 3) | ((index & 0x40) >> 5) | ((index & 0x80) >> 7));
+        }
+    };
+
+    /*
+    value of a hex digit character, 0xFF for anything else
+    */
+    struct hex_value_gen
+    {
+        constexpr unsigned char operator()(size_t c) const
+        {
+            return c >= '0' && c <= '9' ? static_cast<unsigned char>(c - '0') :
+                c >= 'a' && c <= 'f' ? static_cast<unsigned char>(c - 'a' + 10) :
+                c >= 'A' && c <= 'F' ? static_cast<unsigned char>(c - 'A' + 10) : 0xFF;
+        }
+    };
+
+    /*
+    value of a base64 character, 0xFF for anything else, padding included
+    */
+    struct base64_value_gen
+    {
+        constexpr unsigned char operator()(size_t c) const
+        {
+            return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A') :
+                c >= 'a' && c <= 'z' ? static_cast<unsigned char>(c - 'a' + 26) :
+                c >= '0' && c <= '9' ? static_cast<unsigned char>(c - '0' + 52) :
+                c == '+' ? 62 : c == '/' ? 63 : 0xFF;
+        }
+    };
+
+    /*
+    arithmetic in GF(2^8) with the AES polynomial x^8 + x^4 + x^3 + x + 1
+    */
+    struct gf256
+    {
+        static constexpr unsigned int xtime(unsigned int a)
+        {
+            return ((a << 1) ^ ((a & 0x80) ? 0x1b : 0)) & 0xff;
+        }
+
+        static constexpr unsigned int mul(unsigned int a, unsigned int b)
+        {
+            return b == 0 ? 0 : ((b & 1) ? a : 0) ^ mul(xtime(a), b >> 1);
+        }
+
+        static constexpr unsigned int pow(unsigned int a, unsigned int e)
+        {
+            return e == 0 ? 1 : (e & 1) ? mul(a, pow(mul(a, a), e >> 1)) : pow(mul(a, a), e >> 1);
+        }
+
+        //a^254 is the inverse of a, and 0 for 0 as AES wants
+        static constexpr unsigned int inverse(unsigned int a)
+        {
+            return pow(a, 254);
+        }
+
+        static constexpr unsigned int rotl(unsigned int a, unsigned int n)
+        {
+            return ((a << n) | (a >> (8 - n))) & 0xff;
+        }
+    };
+
+    /*
+    the AES S-box: the affine transform of the inverse in GF(2^8)
+    */
+    struct aes_sbox_gen
+    {
+        constexpr unsigned char operator()(size_t index) const
+        {
+            return affine(gf256::inverse(static_cast<unsigned int>(index)));
+        }
+
+        static constexpr unsigned char affine(unsigned int b)
+        {
+            return static_cast<unsigned char>(b ^ gf256::rotl(b, 1) ^ gf256::rotl(b, 2) ^ gf256::rotl(b, 3) ^ gf256::rotl(b, 4) ^ 0x63);
+        }
+    };
+
+    /*
+    the inverse AES S-box
+    */
+    struct aes_inv_sbox_gen
+    {
+        constexpr unsigned char operator()(size_t index) const
+        {
+            return static_cast<unsigned char>(gf256::inverse(affine(static_cast<unsigned int>(index))));
+        }
+
+        static constexpr unsigned int affine(unsigned int b)
+        {
+            return gf256::rotl(b, 1) ^ gf256::rotl(b, 3) ^ gf256::rotl(b, 6) ^ 0x05;
+        }
+    };
+}
+
+#endif
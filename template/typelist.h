@@ -0,0 +1,108 @@
+#ifndef TYPELIST_H_INCLUDED
+#define TYPELIST_H_INCLUDED
+
+#include <cstddef>
+
+namespace stdex
+{
+    /*
+    meta templates over a list of types:
+    typedef typelist<char, int> list;
+    list::size == 2;
+    type_at<list, 1>::type is int;
+    index_of<list, int>::value == 1, list::size when the type is not there;
+    contains<list, long>::value == false;
+    push_back<list, long>::type is typelist<char, int, long>;
+    concat<list, list>::type is typelist<char, int, char, int>;
+    transform<list, std::add_pointer>::type is typelist<char *, int *>;
+    */
+
+    template <typename... T>
+    struct typelist
+    {
+        static constexpr size_t size = sizeof...(T);
+    };
+
+    template <typename... T>
+    constexpr size_t typelist<T...>::size;
+
+    template <typename L, size_t index>
+    struct type_at;
+
+    template <typename T1, typename... TN, size_t index>
+    struct type_at<typelist<T1, TN...>, index>
+    {
+        typedef typename type_at<typelist<TN...>, index - 1>::type type;
+    };
+
+    template <typename T1, typename... TN>
+    struct type_at<typelist<T1, TN...>, 0>
+    {
+        typedef T1 type;
+    };
+
+    template <typename L, typename T>
+    struct index_of;
+
+    template <typename T>
+    struct index_of<typelist<>, T>
+    {
+        static constexpr size_t value = 0;
+    };
+
+    template <typename T1, typename... TN, typename T>
+    struct index_of<typelist<T1, TN...>, T>
+    {
+        static constexpr size_t value = 1 + index_of<typelist<TN...>, T>::value;
+    };
+
+    template <typename... TN, typename T>
+    struct index_of<typelist<T, TN...>, T>
+    {
+        static constexpr size_t value = 0;
+    };
+
+    template <typename L, typename T>
+    struct contains
+    {
+        static constexpr bool value = index_of<L, T>::value < L::size;
+    };
+
+    template <typename L, typename T>
+    struct push_front;
+
+    template <typename... TN, typename T>
+    struct push_front<typelist<TN...>, T>
+    {
+        typedef typelist<T, TN...> type;
+    };
+
+    template <typename L, typename T>
+    struct push_back;
+
+    template <typename... TN, typename T>
+    struct push_back<typelist<TN...>, T>
+    {
+        typedef typelist<TN..., T> type;
+    };
+
+    template <typename A, typename B>
+    struct concat;
+
+    template <typename... A, typename... B>
+    struct concat<typelist<A...>, typelist<B...>>
+    {
+        typedef typelist<A..., B...> type;
+    };
+
+    template <typename L, template <typename> class F>
+    struct transform;
+
+    template <typename... TN, template <typename> class F>
+    struct transform<typelist<TN...>, F>
+    {
+        typedef typelist<typename F<TN>::type...> type;
+    };
+}
+
+#endif
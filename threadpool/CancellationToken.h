@@ -0,0 +1,53 @@
+#ifndef THREAD_POOL_CANCELLATION_TOKEN_H
+#define THREAD_POOL_CANCELLATION_TOKEN_H
+
+#include <memory>
+#include <atomic>
+
+#if defined(_MSC_VER)
+#include <threadpool\Task.h>
+#elif defined(__GNUC__)
+#include <threadpool/Task.h>
+#else
+#error unsupported compiler
+#endif
+
+// read side of a cancellation request. long tasks capture a token and poll
+// it between steps, a default constructed token is never cancelled.
+class CancellationToken {
+public:
+    CancellationToken() {}
+
+    bool cancelled() const
+    {
+        return flag && flag->load(std::memory_order_acquire);
+    }
+
+    // lets an enqueue()d task end with TaskCancelled in its future
+    void throw_if_cancelled() const
+    {
+        if(cancelled())
+            throw TaskCancelled();
+    }
+
+private:
+    friend class CancellationSource;
+    explicit CancellationToken(const std::shared_ptr< std::atomic<bool> > &flag) : flag(flag) {}
+
+    std::shared_ptr< std::atomic<bool> > flag;
+};
+
+// write side, hands out tokens and cancels all of them at once
+class CancellationSource {
+public:
+    CancellationSource() : flag(std::make_shared< std::atomic<bool> >(false)) {}
+
+    CancellationToken token() const { return CancellationToken(flag); }
+    void cancel() { flag->store(true, std::memory_order_release); }
+    bool cancelled() const { return flag->load(std::memory_order_acquire); }
+
+private:
+    std::shared_ptr< std::atomic<bool> > flag;
+};
+
+#endif
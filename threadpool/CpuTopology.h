@@ -0,0 +1,105 @@
+#ifndef THREAD_POOL_CPU_TOPOLOGY_H
+#define THREAD_POOL_CPU_TOPOLOGY_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// cpu and numa layout of the machine, and thread pinning. only linux is
+// supported, everywhere else the pinning calls fail and every cpu reports
+// node 0.
+class CpuTopology {
+public:
+    // numa node of every logical cpu, indexed by cpu id
+    static std::vector<int> cpu_nodes()
+    {
+        std::vector<int> nodes(std::thread::hardware_concurrency(), 0);
+#if defined(__linux__)
+        std::vector<int> online = parse_list(read_line("/sys/devices/system/node/online"));
+        for(int node : online)
+        {
+            std::ostringstream path;
+            path << "/sys/devices/system/node/node" << node << "/cpulist";
+            for(int cpu : parse_list(read_line(path.str())))
+            {
+                if((size_t)cpu >= nodes.size())
+                    nodes.resize(cpu + 1, 0);
+                nodes[cpu] = node;
+            }
+        }
+#endif
+        return nodes;
+    }
+
+    // restrict a thread to the given cpus
+    static bool pin(std::thread &thread, const std::vector<int> &cpus)
+    {
+#if defined(__linux__)
+        if(cpus.empty())
+            return false;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu : cpus)
+        {
+            if(cpu < 0 || cpu >= CPU_SETSIZE)
+                return false;
+            CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#else
+        (void)thread;
+        (void)cpus;
+        return false;
+#endif
+    }
+
+    // the cpu the calling thread runs on right now, -1 when unknown
+    static int current_cpu()
+    {
+#if defined(__linux__)
+        return sched_getcpu();
+#else
+        return -1;
+#endif
+    }
+
+private:
+    static std::string read_line(const std::string &path)
+    {
+        std::ifstream in(path.c_str());
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    // "0-3,8,10-11" -> 0 1 2 3 8 10 11
+    static std::vector<int> parse_list(const std::string &list)
+    {
+        std::vector<int> result;
+        std::istringstream in(list);
+        std::string range;
+        while(std::getline(in, range, ','))
+        {
+            int first = 0, last = 0;
+            char dash = 0;
+            std::istringstream item(range);
+            if(!(item >> first))
+                continue;
+            last = first;
+            if(item >> dash >> last && dash != '-')
+                last = first;
+            for(int i = first; i <= last; ++i)
+                result.push_back(i);
+        }
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef THREAD_POOL_EVENT_COUNT_H
+#define THREAD_POOL_EVENT_COUNT_H
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(__linux__)
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+// lets consumers of a lock free queue sleep without a lock on the fast path.
+// a consumer announces itself with prepare_wait(), checks the queue once
+// more and then either cancel_wait()s or wait()s. a producer pushes and
+// calls notify(), which is a fence and a load while nobody sleeps.
+//
+//     for(;;) {
+//         if(queue.try_pop(item)) break;
+//         EventCount::Key key = ec.prepare_wait();
+//         if(queue.try_pop(item)) { ec.cancel_wait(); break; }
+//         ec.wait(key);
+//     }
+//
+// linux sleeps on a futex, everywhere else on a condition variable.
+class EventCount {
+public:
+    typedef uint32_t Key;
+
+    EventCount() : epoch(0), waiters(0) {}
+    EventCount(const EventCount &) = delete;
+    EventCount& operator=(const EventCount &) = delete;
+
+    Key prepare_wait()
+    {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+
+    void cancel_wait()
+    {
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // returns once notify() was called after prepare_wait()
+    void wait(Key key)
+    {
+#if defined(__linux__)
+        while(epoch.load(std::memory_order_acquire) == key)
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+#else
+        std::unique_lock<std::mutex> lock(mutex);
+        while(epoch.load(std::memory_order_acquire) == key)
+            condition.wait(lock);
+#endif
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify_one() { notify(false); }
+    void notify_all() { notify(true); }
+
+private:
+    void notify(bool all)
+    {
+        // pairs with the increment in prepare_wait(): either the waiter sees
+        // what was pushed before this call or we see the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(waiters.load(std::memory_order_relaxed) == 0)
+            return;
+#if defined(__linux__)
+        epoch.fetch_add(1, std::memory_order_release);
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(&epoch), FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, nullptr, nullptr, 0);
+#else
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            epoch.fetch_add(1, std::memory_order_release);
+        }
+        if(all)
+            condition.notify_all();
+        else
+            condition.notify_one();
+#endif
+    }
+
+    std::atomic<uint32_t> epoch;
+    std::atomic<uint32_t> waiters;
+#if !defined(__linux__)
+    std::mutex mutex;
+    std::condition_variable condition;
+#endif
+};
+
+#endif
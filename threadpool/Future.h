@@ -0,0 +1,405 @@
+#ifndef THREAD_POOL_FUTURE_H
+#define THREAD_POOL_FUTURE_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <utility>
+#include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <condition_variable>
+
+#if defined(_MSC_VER)
+#include <threadpool\Task.h>
+#elif defined(__GNUC__)
+#include <threadpool/Task.h>
+#else
+#error unsupported compiler
+#endif
+
+// where continuations run. ThreadPool::scheduler() posts them to the pool,
+// a default constructed one runs them on the thread that completed the
+// future.
+struct Scheduler {
+    Scheduler() : post(nullptr), context(nullptr) {}
+    Scheduler(void (*post)(void *, Task &&), void *context) : post(post), context(context) {}
+
+    void operator()(Task &&task) const
+    {
+        if(post)
+            post(context, std::move(task));
+        else
+            task();
+    }
+
+    void (*post)(void *, Task &&);
+    void *context;
+};
+
+// what a Future<void> holds
+struct FutureUnit {};
+
+// shared by a Promise and its Futures. callbacks registered with on_ready()
+// run inline on the completing thread and must not throw, they are meant to
+// hand the real work to the scheduler.
+template<class T>
+class FutureState {
+public:
+    typedef typename std::conditional<std::is_void<T>::value, FutureUnit, T>::type value_type;
+
+    explicit FutureState(const Scheduler &scheduler) : scheduler(scheduler), ready(false), has_value(false) {}
+    FutureState(const FutureState &) = delete;
+    FutureState& operator=(const FutureState &) = delete;
+
+    ~FutureState()
+    {
+        if(has_value)
+            get_pointer()->~value_type();
+    }
+
+    void set_value(value_type &&value)
+    {
+        std::vector<Task> callbacks;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(ready)
+                throw std::future_error(std::future_errc::promise_already_satisfied);
+            new (&storage) value_type(std::move(value));
+            has_value = true;
+            ready = true;
+            callbacks.swap(this->callbacks);
+        }
+        completed(callbacks);
+    }
+
+    void set_exception(std::exception_ptr error)
+    {
+        std::vector<Task> callbacks;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(ready)
+                throw std::future_error(std::future_errc::promise_already_satisfied);
+            this->error = error;
+            ready = true;
+            callbacks.swap(this->callbacks);
+        }
+        completed(callbacks);
+    }
+
+    // store what fn returns, or what it throws
+    template<class F>
+    void set_from(F &fn)
+    {
+        try
+        {
+            set_result(fn, std::is_void<T>());
+        }
+        catch(...)
+        {
+            set_exception(std::current_exception());
+        }
+    }
+
+    // right away when the state is ready already
+    void on_ready(Task &&callback)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(!ready)
+            {
+                callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+    bool is_ready()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return ready;
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return ready; });
+    }
+
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period> &timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return condition.wait_for(lock, timeout, [this] { return ready; });
+    }
+
+    // waits, rethrows the stored exception
+    const value_type &value()
+    {
+        wait();
+        if(error)
+            std::rethrow_exception(error);
+        return *get_pointer();
+    }
+
+    const Scheduler scheduler;
+
+private:
+    template<class F>
+    void set_result(F &fn, std::false_type) { set_value(fn()); }
+    template<class F>
+    void set_result(F &fn, std::true_type) { fn(); set_value(FutureUnit()); }
+
+    void completed(std::vector<Task> &callbacks)
+    {
+        condition.notify_all();
+        for(auto &callback : callbacks)
+            callback();
+    }
+
+    value_type *get_pointer() { return reinterpret_cast<value_type *>(&storage); }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool ready;
+    bool has_value;
+    typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type storage;
+    std::exception_ptr error;
+    std::vector<Task> callbacks;
+};
+
+template<class T> class Future;
+
+// result of then(fn): fn takes the value of the future, or nothing for void
+template<class T, class F>
+struct FutureThen {
+    typedef typename std::result_of<F(const T &)>::type type;
+    static type call(FutureState<T> &from, F &fn) { return fn(from.value()); }
+};
+
+template<class F>
+struct FutureThen<void, F> {
+    typedef typename std::result_of<F()>::type type;
+    static type call(FutureState<void> &from, F &fn) { from.value(); return fn(); }
+};
+
+// a future that can be copied and chained. then() never blocks, the
+// continuation is handed to the scheduler once the value is there. a failed
+// future skips the continuation and passes its exception down the chain.
+template<class T>
+class Future {
+public:
+    typedef T value_type;
+
+    Future() {}
+    explicit Future(const std::shared_ptr< FutureState<T> > &state) : state(state) {}
+
+    bool valid() const { return state != nullptr; }
+    bool ready() const { return state->is_ready(); }
+    void wait() const { state->wait(); }
+    template<class Rep, class Period>
+    bool wait_for(const std::chrono::duration<Rep, Period> &timeout) const { return state->wait_for(timeout); }
+
+    // blocks, rethrows the exception of the task
+    T get() const { return get(std::is_void<T>()); }
+
+    template<class F>
+    Future<typename FutureThen<T, F>::type> then(F fn) const;
+
+    // not for user code, the combinators hook in here
+    const std::shared_ptr< FutureState<T> > &shared_state() const { return state; }
+
+private:
+    T get(std::false_type) const { return state->value(); }
+    T get(std::true_type) const { state->value(); }
+
+    std::shared_ptr< FutureState<T> > state;
+};
+
+// producer side of a Future, breaks the promise when dropped unset
+template<class T>
+class Promise {
+public:
+    explicit Promise(const Scheduler &scheduler = Scheduler())
+        : state(std::make_shared< FutureState<T> >(scheduler)) {}
+    Promise(Promise &&other) : state(std::move(other.state)) {}
+    Promise& operator=(Promise &&other)
+    {
+        abandon();
+        state = std::move(other.state);
+        return *this;
+    }
+    Promise(const Promise &) = delete;
+    Promise& operator=(const Promise &) = delete;
+    ~Promise() { abandon(); }
+
+    Future<T> get_future() const { return Future<T>(state); }
+
+    template<class U = T>
+    void set_value(typename std::enable_if<!std::is_void<U>::value, U>::type value) { state->set_value(std::move(value)); }
+    template<class U = T>
+    typename std::enable_if<std::is_void<U>::value>::type set_value() { state->set_value(FutureUnit()); }
+    void set_exception(std::exception_ptr error) { state->set_exception(error); }
+
+private:
+    void abandon()
+    {
+        if(state && !state->is_ready())
+            state->set_exception(std::make_exception_ptr(std::future_error(std::future_errc::broken_promise)));
+    }
+
+    std::shared_ptr< FutureState<T> > state;
+};
+
+// the callable of one ThreadPool::submit(), completes the future when run
+template<class R, class F>
+class FutureTask {
+public:
+    FutureTask(const std::shared_ptr< FutureState<R> > &state, F &&fn) : state(state), fn(std::move(fn)) {}
+
+    void operator()() { state->set_from(fn); }
+    void cancel() { state->set_exception(std::make_exception_ptr(TaskCancelled())); }
+
+private:
+    std::shared_ptr< FutureState<R> > state;
+    F fn;
+};
+
+template<class T, class F>
+class FutureContinuation {
+public:
+    typedef typename FutureThen<T, F>::type result_type;
+
+    FutureContinuation(const std::shared_ptr< FutureState<T> > &from,
+        const std::shared_ptr< FutureState<result_type> > &to, const F &fn)
+        : from(from), to(to), fn(fn) {}
+
+    void operator()()
+    {
+        struct Call {
+            FutureContinuation *self;
+            result_type operator()() { return FutureThen<T, F>::call(*self->from, self->fn); }
+        } call = { this };
+        to->set_from(call);
+    }
+
+    void cancel() { to->set_exception(std::make_exception_ptr(TaskCancelled())); }
+
+    std::shared_ptr< FutureState<T> > from;
+    std::shared_ptr< FutureState<result_type> > to;
+    F fn;
+};
+
+template<class T>
+template<class F>
+Future<typename FutureThen<T, F>::type> Future<T>::then(F fn) const
+{
+    typedef typename FutureThen<T, F>::type R;
+    std::shared_ptr< FutureState<R> > to = std::make_shared< FutureState<R> >(state->scheduler);
+    FutureContinuation<T, F> step(state, to, fn);
+
+    state->on_ready([step]() {
+        std::shared_ptr< FutureState<R> > to = step.to;
+        try
+        {
+            step.from->scheduler(Task(FutureContinuation<T, F>(step)));
+        }
+        catch(...)
+        {
+            // the scheduler refused it, a stopped pool. a failed input
+            // still passes its own exception down
+            std::exception_ptr refused = std::current_exception();
+            try
+            {
+                step.from->value();
+            }
+            catch(...)
+            {
+                refused = std::current_exception();
+            }
+            to->set_exception(refused);
+        }
+    });
+    return Future<R>(to);
+}
+
+template<class T>
+struct FutureAll {
+    typedef std::vector<T> type;
+    static type collect(const std::vector< Future<T> > &inputs)
+    {
+        type values;
+        values.reserve(inputs.size());
+        for(auto &input : inputs)
+            values.push_back(input.get());
+        return values;
+    }
+};
+
+template<>
+struct FutureAll<void> {
+    typedef void type;
+    static void collect(const std::vector< Future<void> > &inputs)
+    {
+        for(auto &input : inputs)
+            input.get();
+    }
+};
+
+// ready once every input is. the values in input order, or the exception
+// of the first input that failed
+template<class T>
+Future<typename FutureAll<T>::type> when_all(const std::vector< Future<T> > &inputs)
+{
+    typedef typename FutureAll<T>::type R;
+    struct Join {
+        std::vector< Future<T> > inputs;
+        std::atomic<size_t> left;
+        std::shared_ptr< FutureState<R> > out;
+        R operator()() { return FutureAll<T>::collect(inputs); }
+    };
+
+    Scheduler scheduler = inputs.empty() ? Scheduler() : inputs[0].shared_state()->scheduler;
+    std::shared_ptr<Join> join = std::make_shared<Join>();
+    join->inputs = inputs;
+    join->left = inputs.size();
+    join->out = std::make_shared< FutureState<R> >(scheduler);
+    if(inputs.empty())
+        join->out->set_from(*join);
+
+    for(auto &input : inputs)
+        input.shared_state()->on_ready([join]() {
+            if(--join->left == 0)
+                join->out->set_from(*join);
+        });
+    return Future<R>(join->out);
+}
+
+// ready as soon as one input is, holds the index of that input
+template<class T>
+Future<size_t> when_any(const std::vector< Future<T> > &inputs)
+{
+    if(inputs.empty())
+        throw std::invalid_argument("when_any of no futures");
+
+    struct First {
+        std::atomic<bool> done;
+        std::shared_ptr< FutureState<size_t> > out;
+    };
+
+    std::shared_ptr<First> first = std::make_shared<First>();
+    first->done = false;
+    first->out = std::make_shared< FutureState<size_t> >(inputs[0].shared_state()->scheduler);
+    for(size_t i = 0; i < inputs.size(); ++i)
+        inputs[i].shared_state()->on_ready([first, i]() {
+            if(!first->done.exchange(true))
+                first->out->set_value(size_t(i));
+        });
+    return Future<size_t>(first->out);
+}
+
+#endif
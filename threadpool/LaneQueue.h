@@ -0,0 +1,226 @@
+#ifndef THREAD_POOL_LANE_QUEUE_H
+#define THREAD_POOL_LANE_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <threadpool\Task.h>
+#include <threadpool\WorkStealingDeque.h>
+#elif defined(__GNUC__)
+#include <threadpool/Task.h>
+#include <threadpool/WorkStealingDeque.h>
+#else
+#error unsupported compiler
+#endif
+
+enum class TaskPriority {
+    high,
+    normal,
+    low
+};
+
+// counters of one lane, all of them cover the lifetime of the pool
+struct LaneStats {
+    size_t depth;                           // tasks waiting right now
+    size_t max_depth;                       // high water mark of depth
+    unsigned long long enqueued;
+    unsigned long long dequeued;
+    unsigned long long promoted;            // taken early by the starvation guard
+    std::chrono::microseconds total_wait;   // enqueue to dequeue, summed
+    std::chrono::microseconds max_wait;
+};
+
+// the shared queue of ThreadPool: an earliest deadline first lane on top of
+// three FIFO priority lanes. a task that waited longer than the starvation
+// limit is served next whatever lane it is in. not thread safe, the pool
+// only touches it under queue_mutex. size() alone may be read without the
+// lock, as an estimate.
+class LaneQueue {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    LaneQueue() : count(0), sequence(0), starvation_limit(std::chrono::milliseconds(200))
+    {
+        for(size_t i = 0; i < lane_count; ++i)
+        {
+            LaneStats &s = stats[i];
+            s.depth = s.max_depth = 0;
+            s.enqueued = s.dequeued = s.promoted = 0;
+            s.total_wait = s.max_wait = std::chrono::microseconds(0);
+        }
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t size() const { return count.load(std::memory_order_relaxed); }
+    // tasks that should run before anything parked in a worker deque
+    size_t urgent() const { return deadlines.size() + lanes[lane_of(TaskPriority::high)].size(); }
+
+    void set_starvation_limit(clock::duration limit) { starvation_limit = limit; }
+
+    void push(Task &&task, TaskPriority priority, clock::time_point now)
+    {
+        size_t lane = lane_of(priority);
+        Entry entry;
+        entry.task = std::move(task);
+        entry.queued = now;
+        lanes[lane].push_back(std::move(entry));
+        pushed(lane);
+    }
+
+    void push_deadline(Task &&task, clock::time_point deadline, clock::time_point now)
+    {
+        DeadlineEntry entry;
+        entry.task = std::move(task);
+        entry.queued = now;
+        entry.deadline = deadline;
+        entry.sequence = sequence++;
+        deadlines.push_back(std::move(entry));
+        std::push_heap(deadlines.begin(), deadlines.end(), later);
+        pushed(deadline_lane);
+    }
+
+    bool pop(Task &task, clock::time_point now)
+    {
+        if(empty())
+            return false;
+
+        // starvation guard: the oldest task past the limit wins
+        size_t lane = lane_count;
+        clock::time_point oldest = now - starvation_limit;
+        for(size_t i = 1; i < lane_count; ++i)
+        {
+            if(!lanes[i].empty() && lanes[i].front().queued <= oldest)
+            {
+                oldest = lanes[i].front().queued;
+                lane = i;
+            }
+        }
+
+        if(lane != lane_count)
+        {
+            for(size_t i = 0; i < lane; ++i)
+            {
+                if(i == deadline_lane ? !deadlines.empty() : !lanes[i].empty())
+                {
+                    ++stats[lane].promoted;
+                    break;
+                }
+            }
+        }
+        else if(!deadlines.empty())
+        {
+            lane = deadline_lane;
+        }
+        else
+        {
+            for(lane = 1; lanes[lane].empty(); ++lane)
+                ;
+        }
+
+        clock::time_point queued;
+        if(lane == deadline_lane)
+        {
+            std::pop_heap(deadlines.begin(), deadlines.end(), later);
+            task = std::move(deadlines.back().task);
+            queued = deadlines.back().queued;
+            deadlines.pop_back();
+        }
+        else
+        {
+            Entry entry = lanes[lane].pop_front();
+            task = std::move(entry.task);
+            queued = entry.queued;
+        }
+        popped(lane, now - queued);
+        return true;
+    }
+
+    // normal lane only, no reordering. used to move a batch of ordinary
+    // work into a worker deque
+    bool pop_normal(Task &task, clock::time_point now)
+    {
+        size_t lane = lane_of(TaskPriority::normal);
+        if(lanes[lane].empty())
+            return false;
+        Entry entry = lanes[lane].pop_front();
+        task = std::move(entry.task);
+        popped(lane, now - entry.queued);
+        return true;
+    }
+
+    // enqueue time of the task that has waited longest, only valid when not empty
+    clock::time_point oldest() const
+    {
+        clock::time_point result = clock::time_point::max();
+        for(size_t i = 1; i < lane_count; ++i)
+            if(!lanes[i].empty() && lanes[i].front().queued < result)
+                result = lanes[i].front().queued;
+        if(!deadlines.empty() && deadlines.front().queued < result)
+            result = deadlines.front().queued;
+        return result;
+    }
+
+    size_t normal_size() const { return lanes[lane_of(TaskPriority::normal)].size(); }
+
+    LaneStats lane_stats(TaskPriority priority) const { return stats[lane_of(priority)]; }
+    LaneStats deadline_stats() const { return stats[deadline_lane]; }
+
+private:
+    static const size_t lane_count = 4;
+    static const size_t deadline_lane = 0;
+
+    static size_t lane_of(TaskPriority priority) { return 1 + (size_t)priority; }
+
+    struct Entry {
+        Task task;
+        clock::time_point queued;
+    };
+
+    struct DeadlineEntry {
+        Task task;
+        clock::time_point queued;
+        clock::time_point deadline;
+        unsigned long long sequence;
+    };
+
+    // heap order, the earliest deadline ends up at the front
+    static bool later(const DeadlineEntry &a, const DeadlineEntry &b)
+    {
+        if(a.deadline != b.deadline)
+            return a.deadline > b.deadline;
+        return a.sequence > b.sequence;
+    }
+
+    void pushed(size_t lane)
+    {
+        count.store(size() + 1, std::memory_order_relaxed);
+        LaneStats &s = stats[lane];
+        ++s.enqueued;
+        if(++s.depth > s.max_depth)
+            s.max_depth = s.depth;
+    }
+
+    void popped(size_t lane, clock::duration wait)
+    {
+        count.store(size() - 1, std::memory_order_relaxed);
+        LaneStats &s = stats[lane];
+        ++s.dequeued;
+        --s.depth;
+        std::chrono::microseconds us = std::chrono::duration_cast<std::chrono::microseconds>(wait);
+        s.total_wait += us;
+        if(us > s.max_wait)
+            s.max_wait = us;
+    }
+
+    RingDeque<Entry> lanes[lane_count];     // lanes[deadline_lane] stays empty
+    std::vector<DeadlineEntry> deadlines;
+    std::atomic<size_t> count;
+    unsigned long long sequence;
+    clock::duration starvation_limit;
+    LaneStats stats[lane_count];
+};
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef THREAD_POOL_MPMC_QUEUE_H
+#define THREAD_POOL_MPMC_QUEUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <threadpool\WorkStealingDeque.h>
+#elif defined(__GNUC__)
+#include <threadpool/WorkStealingDeque.h>
+#else
+#error unsupported compiler
+#endif
+
+// bounded multi producer multi consumer ring. every cell carries a sequence
+// number that tells a producer whether the cell is free for its lap and a
+// consumer whether it has been filled, so the only shared writes are one CAS
+// on head or tail. neither side ever blocks the other.
+template<class T>
+class BoundedMpmcQueue {
+public:
+    // capacity is rounded up to a power of two
+    explicit BoundedMpmcQueue(size_t capacity = 1024)
+        : mask(round_up(capacity) - 1), cells(new Cell[mask + 1]), enqueue_pos(0), dequeue_pos(0)
+    {
+        for(size_t i = 0; i <= mask; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    BoundedMpmcQueue(const BoundedMpmcQueue &) = delete;
+    BoundedMpmcQueue& operator=(const BoundedMpmcQueue &) = delete;
+
+    // false when full, value is left untouched then
+    bool try_push(T &&value)
+    {
+        Cell *cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if(dif == 0)
+            {
+                if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0)
+                return false;
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &value)
+    {
+        Cell *cell;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(dif == 0)
+            {
+                if(dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0)
+                return false;
+            else
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // a snapshot, items being pushed or popped right now are counted
+    size_t size() const
+    {
+        size_t tail = dequeue_pos.load();
+        size_t head = enqueue_pos.load();
+        return head > tail ? head - tail : 0;
+    }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return mask + 1; }
+
+private:
+    static const size_t cache_line = 64;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_up(size_t n)
+    {
+        size_t result = 2;
+        while(result < n)
+            result <<= 1;
+        return result;
+    }
+
+    // producers and consumers each get their own cache line, away from the
+    // read only part
+    char pad0[cache_line];
+    const size_t mask;
+    const std::unique_ptr<Cell[]> cells;
+    char pad1[cache_line - sizeof(size_t) - sizeof(std::unique_ptr<Cell[]>)];
+    std::atomic<size_t> enqueue_pos;
+    char pad2[cache_line - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeue_pos;
+    char pad3[cache_line - sizeof(std::atomic<size_t>)];
+};
+
+// unbounded variant: the lock free ring plus a locked overflow list that is
+// only used while the ring is full. once something overflowed new items
+// queue up behind it until the overflow is drained, so the order stays FIFO
+// apart from the items racing with the switch.
+template<class T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity = 1024) : ring(capacity), overflowed(0) {}
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue& operator=(const MpmcQueue &) = delete;
+
+    void push(T &&value)
+    {
+        if(overflowed.load(std::memory_order_acquire) == 0 && ring.try_push(std::move(value)))
+            return;
+        std::unique_lock<std::mutex> lock(overflow_mutex);
+        overflow.push_back(std::move(value));
+        overflowed.store(overflow.size(), std::memory_order_release);
+    }
+
+    bool try_pop(T &value)
+    {
+        if(ring.try_pop(value))
+            return true;
+        if(overflowed.load(std::memory_order_acquire) == 0)
+            return false;
+
+        std::unique_lock<std::mutex> lock(overflow_mutex);
+        if(overflow.empty())
+            return ring.try_pop(value);
+        value = overflow.pop_front();
+        // move what fits back into the ring
+        while(!overflow.empty() && ring.try_push(std::move(overflow.front())))
+            overflow.pop_front();
+        overflowed.store(overflow.size(), std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const { return ring.size() + overflowed.load(); }
+    bool empty() const { return size() == 0; }
+
+private:
+    BoundedMpmcQueue<T> ring;
+    std::mutex overflow_mutex;
+    RingDeque<T> overflow;
+    std::atomic<size_t> overflowed;
+};
+
+#endif
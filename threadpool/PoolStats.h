@@ -0,0 +1,197 @@
+#ifndef THREAD_POOL_POOL_STATS_H
+#define THREAD_POOL_POOL_STATS_H
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <chrono>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// counters of ThreadPool. every worker owns one shard and is its only
+// writer, so updates are a relaxed load and store on a line nobody else
+// writes. define THREADPOOL_NO_STATS to compile all of it out, stats() then
+// only reports the number of workers.
+
+// durations in power of two buckets: bucket i counts [2^i, 2^(i+1)) ns,
+// bucket 0 also takes everything below 2ns and the last one everything
+// above
+struct HistogramSnapshot {
+    static const size_t bucket_count = 40;
+
+    HistogramSnapshot() : count(0), total(0)
+    {
+        for(size_t i = 0; i < bucket_count; ++i)
+            buckets[i] = 0;
+    }
+
+    void merge(const HistogramSnapshot &other)
+    {
+        for(size_t i = 0; i < bucket_count; ++i)
+            buckets[i] += other.buckets[i];
+        count += other.count;
+        total += other.total;
+    }
+
+    std::chrono::nanoseconds mean() const
+    {
+        return std::chrono::nanoseconds(count ? total / count : 0);
+    }
+
+    // upper bound of the bucket holding the given fraction, 0.99 for p99
+    std::chrono::nanoseconds percentile(double fraction) const
+    {
+        double wanted = fraction * count;
+        unsigned long long seen = 0;
+        for(size_t i = 0; i < bucket_count && count; ++i)
+        {
+            seen += buckets[i];
+            if(seen >= wanted && seen > 0)
+                return std::chrono::nanoseconds(2ull << i);
+        }
+        return std::chrono::nanoseconds(0);
+    }
+
+    unsigned long long buckets[bucket_count];
+    unsigned long long count;
+    unsigned long long total;       // nanoseconds
+};
+
+struct WorkerStatsSnapshot {
+    WorkerStatsSnapshot() : executed(0), max_queue_depth(0), busy(0), idle(0) {}
+
+    void merge(const WorkerStatsSnapshot &other)
+    {
+        executed += other.executed;
+        if(other.max_queue_depth > max_queue_depth)
+            max_queue_depth = other.max_queue_depth;
+        busy += other.busy;
+        idle += other.idle;
+        wait.merge(other.wait);
+        run.merge(other.run);
+    }
+
+    unsigned long long executed;
+    // deepest queue seen when taking a task
+    unsigned long long max_queue_depth;
+    std::chrono::nanoseconds busy;      // running tasks
+    std::chrono::nanoseconds idle;      // asleep waiting for work
+    HistogramSnapshot wait;             // enqueue to start
+    HistogramSnapshot run;              // start to end
+};
+
+struct PoolStatsSnapshot {
+    PoolStatsSnapshot() : threads(0) {}
+
+    size_t threads;
+    // one entry per worker slot, a slot reused after a worker retired keeps
+    // counting
+    std::vector<WorkerStatsSnapshot> workers;
+    WorkerStatsSnapshot total;
+
+    // one line, what the periodic plog dump writes
+    std::string summary() const
+    {
+        std::ostringstream out;
+        out << "threads=" << threads
+            << " executed=" << total.executed
+            << " max_depth=" << total.max_queue_depth
+            << " wait_mean_us=" << total.wait.mean().count() / 1000
+            << " wait_p99_us=" << total.wait.percentile(0.99).count() / 1000
+            << " run_mean_us=" << total.run.mean().count() / 1000
+            << " run_p99_us=" << total.run.percentile(0.99).count() / 1000
+            << " busy_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(total.busy).count()
+            << " idle_ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(total.idle).count();
+        return out.str();
+    }
+};
+
+#if !defined(THREADPOOL_NO_STATS)
+
+// the shard of one worker, padded so neighbours do not share its lines
+class WorkerCounters {
+public:
+    WorkerCounters() : executed(0), max_queue_depth(0), busy(0), idle(0), wait_total(0), run_total(0)
+    {
+        for(size_t i = 0; i < HistogramSnapshot::bucket_count; ++i)
+        {
+            wait[i].store(0, std::memory_order_relaxed);
+            run[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // owner thread only
+    void task_done(uint64_t wait_ns, uint64_t run_ns, size_t depth)
+    {
+        add(executed, 1);
+        add(busy, run_ns);
+        add(wait_total, wait_ns);
+        add(run_total, run_ns);
+        add(wait[bucket(wait_ns)], 1);
+        add(run[bucket(run_ns)], 1);
+        if(depth > max_queue_depth.load(std::memory_order_relaxed))
+            max_queue_depth.store(depth, std::memory_order_relaxed);
+    }
+
+    void idled(uint64_t ns) { add(idle, ns); }
+
+    WorkerStatsSnapshot snapshot() const
+    {
+        WorkerStatsSnapshot s;
+        s.executed = executed.load(std::memory_order_relaxed);
+        s.max_queue_depth = max_queue_depth.load(std::memory_order_relaxed);
+        s.busy = std::chrono::nanoseconds(busy.load(std::memory_order_relaxed));
+        s.idle = std::chrono::nanoseconds(idle.load(std::memory_order_relaxed));
+        for(size_t i = 0; i < HistogramSnapshot::bucket_count; ++i)
+        {
+            s.wait.buckets[i] = wait[i].load(std::memory_order_relaxed);
+            s.run.buckets[i] = run[i].load(std::memory_order_relaxed);
+            s.wait.count += s.wait.buckets[i];
+            s.run.count += s.run.buckets[i];
+        }
+        s.wait.total = wait_total.load(std::memory_order_relaxed);
+        s.run.total = run_total.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    static void add(std::atomic<uint64_t> &counter, uint64_t value)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    static size_t bucket(uint64_t ns)
+    {
+        if(ns < 2)
+            return 0;
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, ns);
+        size_t b = index;
+#elif defined(__GNUC__)
+        size_t b = 63 - __builtin_clzll(ns);
+#else
+#error unsupported compiler
+#endif
+        return b < HistogramSnapshot::bucket_count ? b : HistogramSnapshot::bucket_count - 1;
+    }
+
+    char pad0[64];
+    std::atomic<uint64_t> executed;
+    std::atomic<uint64_t> max_queue_depth;
+    std::atomic<uint64_t> busy;
+    std::atomic<uint64_t> idle;
+    std::atomic<uint64_t> wait_total;
+    std::atomic<uint64_t> run_total;
+    std::atomic<uint64_t> wait[HistogramSnapshot::bucket_count];
+    std::atomic<uint64_t> run[HistogramSnapshot::bucket_count];
+    char pad1[64];
+};
+
+#endif
+
+#endif
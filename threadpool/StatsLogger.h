@@ -0,0 +1,61 @@
+#ifndef THREAD_POOL_STATS_LOGGER_H
+#define THREAD_POOL_STATS_LOGGER_H
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+
+#if defined(_MSC_VER)
+#include <threadpool\ThreadPool.h>
+#include <plog\Log.h>
+#elif defined(__GNUC__)
+#include <threadpool/ThreadPool.h>
+#include <plog/Log.h>
+#else
+#error unsupported compiler
+#endif
+
+// writes ThreadPool::stats() through plog every period until destroyed.
+// kept apart from ThreadPool.h so the pool does not depend on plog.
+class PoolStatsLogger {
+public:
+    PoolStatsLogger(const ThreadPool &pool, std::chrono::steady_clock::duration period,
+        const std::string &name = "ThreadPool", plog::Severity severity = plog::info)
+        : pool(pool), period(period), name(name), severity(severity), stopping(false),
+          thread(&PoolStatsLogger::loop, this)
+    {
+    }
+    PoolStatsLogger(const PoolStatsLogger &) = delete;
+    PoolStatsLogger& operator=(const PoolStatsLogger &) = delete;
+
+    ~PoolStatsLogger()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_one();
+        thread.join();
+    }
+
+private:
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(!condition.wait_for(lock, period, [this] { return stopping; }))
+            LOG(severity) << name << ": " << pool.stats().summary();
+    }
+
+    const ThreadPool &pool;
+    std::chrono::steady_clock::duration period;
+    std::string name;
+    plog::Severity severity;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    std::thread thread;
+};
+
+#endif
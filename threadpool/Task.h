@@ -0,0 +1,401 @@
+#ifndef THREAD_POOL_TASK_H
+#define THREAD_POOL_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <mutex>
+#include <vector>
+#include <future>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+
+// what the future of a task dropped by ThreadPool::shutdown_now() holds, and
+// what CancellationToken::throw_if_cancelled() throws
+class TaskCancelled : public std::runtime_error {
+public:
+    TaskCancelled() : std::runtime_error("task cancelled") {}
+};
+
+// move only replacement of std::function<void()>. callables that fit in
+// inline_size bytes and are nothrow movable live inside the task itself, so
+// submitting them to the pool does not touch the heap.
+class Task {
+public:
+    // big enough for a 48 byte capture plus the promise of enqueue()
+    static const size_t inline_size = 80;
+
+    Task() : ops(nullptr)
+    {
+        set_enqueued(0);
+    }
+
+    template<class F, class = typename std::enable_if<
+        !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F &&f) : ops(nullptr)
+    {
+        set_enqueued(0);
+        typedef typename std::decay<F>::type functor;
+        construct<functor>(std::forward<F>(f), std::integral_constant<bool, fits_inline<functor>::value>());
+    }
+
+    Task(Task &&other) noexcept : ops(other.ops)
+    {
+        set_enqueued(other.get_enqueued());
+        if(ops)
+        {
+            ops->move(&storage, &other.storage);
+            other.ops = nullptr;
+        }
+    }
+
+    Task& operator=(Task &&other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            ops = other.ops;
+            set_enqueued(other.get_enqueued());
+            if(ops)
+            {
+                ops->move(&storage, &other.storage);
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task& operator=(const Task &) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()() { ops->invoke(&storage); }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    void reset()
+    {
+        if(ops)
+        {
+            ops->destroy(&storage);
+            ops = nullptr;
+        }
+    }
+
+    // drop the task without running it. callables with a cancel() member,
+    // like the one behind enqueue(), get to complete their future first
+    void cancel()
+    {
+        if(ops)
+        {
+            ops->cancel(&storage);
+            reset();
+        }
+    }
+
+    // steady clock nanoseconds at enqueue, kept by ThreadPool for its
+    // statistics. always 0 with THREADPOOL_NO_STATS
+#if defined(THREADPOOL_NO_STATS)
+    void set_enqueued(long long) {}
+    long long get_enqueued() const { return 0; }
+#else
+    void set_enqueued(long long ns) { enqueued = ns; }
+    long long get_enqueued() const { return enqueued; }
+#endif
+
+    template<class F>
+    struct fits_inline {
+        static const bool value = sizeof(F) <= inline_size
+            && alignof(F) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<F>::value;
+    };
+
+private:
+    struct Ops {
+        void (*invoke)(void *);
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *);
+        void (*cancel)(void *);
+    };
+
+    template<class F>
+    struct has_cancel {
+        template<class U>
+        static auto test(U *u) -> decltype(u->cancel(), std::true_type());
+        template<class U>
+        static std::false_type test(...);
+        static const bool value = decltype(test<F>(nullptr))::value;
+    };
+
+    template<class F>
+    static void cancel(F &f, std::true_type) { f.cancel(); }
+    template<class F>
+    static void cancel(F &, std::false_type) {}
+
+    template<class F>
+    struct InlineOps {
+        static void invoke(void *p) { (*static_cast<F *>(p))(); }
+        static void move(void *dst, void *src)
+        {
+            new (dst) F(std::move(*static_cast<F *>(src)));
+            static_cast<F *>(src)->~F();
+        }
+        static void destroy(void *p) { static_cast<F *>(p)->~F(); }
+        static void cancel(void *p) { Task::cancel(*static_cast<F *>(p), std::integral_constant<bool, has_cancel<F>::value>()); }
+        static const Ops table;
+    };
+
+    template<class F>
+    struct HeapOps {
+        static void invoke(void *p) { (**static_cast<F **>(p))(); }
+        static void move(void *dst, void *src) { *static_cast<F **>(dst) = *static_cast<F **>(src); }
+        static void destroy(void *p) { delete *static_cast<F **>(p); }
+        static void cancel(void *p) { Task::cancel(**static_cast<F **>(p), std::integral_constant<bool, has_cancel<F>::value>()); }
+        static const Ops table;
+    };
+
+    template<class F, class G>
+    void construct(G &&f, std::true_type)
+    {
+        new (&storage) F(std::forward<G>(f));
+        ops = &InlineOps<F>::table;
+    }
+
+    template<class F, class G>
+    void construct(G &&f, std::false_type)
+    {
+        *reinterpret_cast<F **>(&storage) = new F(std::forward<G>(f));
+        ops = &HeapOps<F>::table;
+    }
+
+    typename std::aligned_storage<inline_size, alignof(std::max_align_t)>::type storage;
+    const Ops *ops;
+#if !defined(THREADPOOL_NO_STATS)
+    // sits in what would otherwise be padding after ops
+    long long enqueued;
+#endif
+};
+
+template<class F>
+const Task::Ops Task::InlineOps<F>::table = { &InlineOps<F>::invoke, &InlineOps<F>::move, &InlineOps<F>::destroy, &InlineOps<F>::cancel };
+
+template<class F>
+const Task::Ops Task::HeapOps<F>::table = { &HeapOps<F>::invoke, &HeapOps<F>::move, &HeapOps<F>::destroy, &HeapOps<F>::cancel };
+
+// the block caches the calling thread has touched, one per block size. a
+// worker about to sleep hands its blocks back to the shared depots, so blocks
+// freed on one thread are not stranded there while another runs out.
+class BlockCacheList {
+public:
+    struct Node {
+        void (*release)(Node *);
+        Node *next;
+    };
+
+    static void link(Node *node)
+    {
+        node->next = head();
+        head() = node;
+    }
+
+    static void unlink(Node *node)
+    {
+        for(Node **p = &head(); *p; p = &(*p)->next)
+            if(*p == node)
+            {
+                *p = node->next;
+                break;
+            }
+    }
+
+    static void release()
+    {
+        for(Node *node = head(); node; node = node->next)
+            node->release(node);
+    }
+
+private:
+    static Node *&head()
+    {
+        static thread_local Node *node = nullptr;
+        return node;
+    }
+};
+
+// fixed size block cache behind PooledAllocator. every thread keeps a small
+// stack of blocks and only trades batches with the shared depot, so the
+// common allocate/deallocate pair takes no lock at all.
+template<size_t Size>
+class BlockCache {
+public:
+    static void *allocate()
+    {
+        Local &l = local();
+        if(l.count == 0)
+            depot().take(l);
+        if(l.count == 0)
+            return ::operator new(Size);
+        return l.blocks[--l.count];
+    }
+
+    static void deallocate(void *p)
+    {
+        Local &l = local();
+        if(l.count == capacity)
+            depot().give(l, capacity - batch);
+        l.blocks[l.count++] = p;
+    }
+
+private:
+    static const size_t capacity = 64;
+    static const size_t batch = capacity / 2;
+
+    struct Local : BlockCacheList::Node {
+        Local() : count(0)
+        {
+            release = &Local::release_all;
+            BlockCacheList::link(this);
+        }
+        ~Local()
+        {
+            BlockCacheList::unlink(this);
+            while(count)
+                ::operator delete(blocks[--count]);
+        }
+        static void release_all(BlockCacheList::Node *node)
+        {
+            Local &l = *static_cast<Local *>(node);
+            if(l.count)
+                depot().give(l, 0);
+        }
+        void *blocks[capacity];
+        size_t count;
+    };
+
+    struct Depot {
+        ~Depot()
+        {
+            for(void *p : blocks)
+                ::operator delete(p);
+        }
+        void take(Local &l)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(l.count < batch && !blocks.empty())
+            {
+                l.blocks[l.count++] = blocks.back();
+                blocks.pop_back();
+            }
+        }
+        // keeps the last keep blocks in the thread cache
+        void give(Local &l, size_t keep)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(l.count > keep)
+                blocks.push_back(l.blocks[--l.count]);
+        }
+        std::mutex mutex;
+        std::vector<void *> blocks;
+    };
+
+    static Local &local()
+    {
+        static thread_local Local l;
+        return l;
+    }
+
+    static Depot &depot()
+    {
+        static Depot d;
+        return d;
+    }
+};
+
+// allocator handed to std::promise so the shared state of enqueue() is
+// recycled instead of going back to the heap for every task
+template<class T>
+class PooledAllocator {
+public:
+    typedef T value_type;
+
+    PooledAllocator() {}
+    template<class U>
+    PooledAllocator(const PooledAllocator<U> &) {}
+
+    T *allocate(size_t n)
+    {
+        if(n != 1 || alignof(T) > alignof(std::max_align_t))
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        return static_cast<T *>(BlockCache<block_size>::allocate());
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        if(n != 1 || alignof(T) > alignof(std::max_align_t))
+            ::operator delete(p);
+        else
+            BlockCache<block_size>::deallocate(p);
+    }
+
+private:
+    // round up so types of similar size share one cache
+    static const size_t block_size = (sizeof(T) + 15) & ~(size_t)15;
+};
+
+template<class T, class U>
+bool operator==(const PooledAllocator<T> &, const PooledAllocator<U> &) { return true; }
+template<class T, class U>
+bool operator!=(const PooledAllocator<T> &, const PooledAllocator<U> &) { return false; }
+
+// the callable and the promise of one enqueue(), stored inline in a Task
+template<class R, class F>
+class PromiseTask {
+public:
+    PromiseTask(std::promise<R> &&promise, F &&fn) : promise(std::move(promise)), fn(std::move(fn)) {}
+
+    void operator()()
+    {
+        try
+        {
+            promise.set_value(fn());
+        }
+        catch(...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    void cancel() { promise.set_exception(std::make_exception_ptr(TaskCancelled())); }
+
+private:
+    std::promise<R> promise;
+    F fn;
+};
+
+template<class F>
+class PromiseTask<void, F> {
+public:
+    PromiseTask(std::promise<void> &&promise, F &&fn) : promise(std::move(promise)), fn(std::move(fn)) {}
+
+    void operator()()
+    {
+        try
+        {
+            fn();
+            promise.set_value();
+        }
+        catch(...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    void cancel() { promise.set_exception(std::make_exception_ptr(TaskCancelled())); }
+
+private:
+    std::promise<void> promise;
+    F fn;
+};
+
+#endif
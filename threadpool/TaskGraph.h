@@ -0,0 +1,209 @@
+#ifndef THREAD_POOL_TASK_GRAPH_H
+#define THREAD_POOL_TASK_GRAPH_H
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+
+#if defined(_MSC_VER)
+#include <threadpool\ThreadPool.h>
+#elif defined(__GNUC__)
+#include <threadpool/ThreadPool.h>
+#else
+#error unsupported compiler
+#endif
+
+// a DAG of tasks run on a ThreadPool. a node is posted once all of its
+// inputs have finished, nobody waits inside a worker. when a node throws,
+// everything downstream of it is skipped and run() reports the first
+// exception.
+//
+//     TaskGraph graph(pool);
+//     auto arp = graph.add([&] { resolve(hosts); });
+//     auto syn = graph.add([&] { syn_scan(hosts); });
+//     auto os  = graph.add([&] { fingerprint(hosts); });
+//     graph.precede(arp, syn);
+//     graph.precede(syn, os);
+//     graph.run().get();
+class TaskGraph {
+public:
+    typedef size_t Node;
+
+    explicit TaskGraph(ThreadPool &pool) : pool(pool) {}
+    TaskGraph(const TaskGraph &) = delete;
+    TaskGraph& operator=(const TaskGraph &) = delete;
+
+    Node add(std::function<void()> fn)
+    {
+        nodes.push_back(Spec());
+        nodes.back().fn = std::move(fn);
+        return nodes.size() - 1;
+    }
+
+    // after runs once before has finished
+    void precede(Node before, Node after)
+    {
+        if(before >= nodes.size() || after >= nodes.size() || before == after)
+            throw std::invalid_argument("bad TaskGraph node");
+        nodes[before].successors.push_back(after);
+        ++nodes[after].inputs;
+    }
+
+    size_t size() const { return nodes.size(); }
+
+    // runs every node once. the graph is copied, it can be changed or run
+    // again while this run is going on. throws std::logic_error on a cycle.
+    Future<void> run()
+    {
+        check_acyclic();
+
+        std::shared_ptr<Run> state = std::make_shared<Run>(nodes, pool.scheduler());
+        Future<void> done(state->done);
+        if(nodes.empty())
+        {
+            state->done->set_value(FutureUnit());
+            return done;
+        }
+        for(Node i = 0; i < nodes.size(); ++i)
+            if(nodes[i].inputs == 0)
+                post_node(pool, state, i);
+        return done;
+    }
+
+private:
+    struct Spec {
+        Spec() : inputs(0) {}
+        std::function<void()> fn;
+        std::vector<Node> successors;
+        size_t inputs;
+    };
+
+    // one execution of the graph
+    struct Run {
+        Run(const std::vector<Spec> &nodes, const Scheduler &scheduler)
+            : nodes(nodes), waiting(new std::atomic<size_t>[nodes.size()]),
+              skipped(new std::atomic<bool>[nodes.size()]), left(nodes.size()),
+              done(std::make_shared< FutureState<void> >(scheduler))
+        {
+            for(size_t i = 0; i < nodes.size(); ++i)
+            {
+                waiting[i] = nodes[i].inputs;
+                skipped[i] = false;
+            }
+        }
+
+        std::vector<Spec> nodes;
+        std::unique_ptr< std::atomic<size_t>[] > waiting;
+        std::unique_ptr< std::atomic<bool>[] > skipped;
+        std::atomic<size_t> left;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+        std::shared_ptr< FutureState<void> > done;
+    };
+
+    static void execute(ThreadPool &pool, const std::shared_ptr<Run> &state, Node node)
+    {
+        bool skip = false;
+        try
+        {
+            state->nodes[node].fn();
+        }
+        catch(...)
+        {
+            fail(state, std::current_exception());
+            skip = true;
+        }
+        finish(pool, state, node, skip);
+    }
+
+    // count the successors down, the last input to finish posts them.
+    // skipped nodes are not posted at all, only walked to keep the count
+    static void finish(ThreadPool &pool, const std::shared_ptr<Run> &state, Node node, bool skip)
+    {
+        std::vector<Node> walk(1, node);
+        bool skipping = skip;
+        while(!walk.empty())
+        {
+            Node current = walk.back();
+            walk.pop_back();
+            for(Node next : state->nodes[current].successors)
+            {
+                if(skipping)
+                    state->skipped[next] = true;
+                if(--state->waiting[next] != 0)
+                    continue;
+                if(state->skipped[next])
+                    walk.push_back(next);
+                else
+                    post_node(pool, state, next);
+            }
+            if(--state->left == 0)
+                complete(state);
+            skipping = true;
+        }
+    }
+
+    static void post_node(ThreadPool &pool, const std::shared_ptr<Run> &state, Node node)
+    {
+        try
+        {
+            pool.post([state, node, &pool] { execute(pool, state, node); });
+        }
+        catch(...)
+        {
+            fail(state, std::current_exception());
+            finish(pool, state, node, true);
+        }
+    }
+
+    static void fail(const std::shared_ptr<Run> &state, std::exception_ptr error)
+    {
+        std::unique_lock<std::mutex> lock(state->error_mutex);
+        if(!state->error)
+            state->error = error;
+    }
+
+    static void complete(const std::shared_ptr<Run> &state)
+    {
+        std::exception_ptr error;
+        {
+            std::unique_lock<std::mutex> lock(state->error_mutex);
+            error = state->error;
+        }
+        if(error)
+            state->done->set_exception(error);
+        else
+            state->done->set_value(FutureUnit());
+    }
+
+    // Kahn's algorithm on the input counts
+    void check_acyclic() const
+    {
+        std::vector<size_t> inputs(nodes.size());
+        std::vector<Node> ready;
+        for(Node i = 0; i < nodes.size(); ++i)
+            if((inputs[i] = nodes[i].inputs) == 0)
+                ready.push_back(i);
+        size_t seen = 0;
+        while(!ready.empty())
+        {
+            Node node = ready.back();
+            ready.pop_back();
+            ++seen;
+            for(Node next : nodes[node].successors)
+                if(--inputs[next] == 0)
+                    ready.push_back(next);
+        }
+        if(seen != nodes.size())
+            throw std::logic_error("TaskGraph has a cycle");
+    }
+
+    ThreadPool &pool;
+    std::vector<Spec> nodes;
+};
+
+#endif
@@ -2,119 +2,1413 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
 #include <sstream>
+#include <chrono>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <threadpool\Task.h>
+#include <threadpool\WorkStealingDeque.h>
+#include <threadpool\LaneQueue.h>
+#include <threadpool\CpuTopology.h>
+#include <threadpool\MpmcQueue.h>
+#include <threadpool\Future.h>
+#include <threadpool\CancellationToken.h>
+#include <threadpool\PoolStats.h>
+#elif defined(__GNUC__)
+#include <threadpool/Task.h>
+#include <threadpool/WorkStealingDeque.h>
+#include <threadpool/LaneQueue.h>
+#include <threadpool/CpuTopology.h>
+#include <threadpool/MpmcQueue.h>
+#include <threadpool/Future.h>
+#include <threadpool/CancellationToken.h>
+#include <threadpool/PoolStats.h>
+#else
+#error unsupported compiler
+#endif
 
 class ThreadPool {
 public:
-    ThreadPool(size_t);
+    enum class Mode {
+        fifo,           // one shared queue, strict FIFO
+        work_stealing,  // one deque per worker plus a global injection queue
+        lock_free       // normal priority work goes through a lock free ring
+    };
+    typedef TaskPriority Priority;
+    typedef std::chrono::steady_clock clock;
+
+    ThreadPool(size_t, Mode mode = Mode::fifo);
+    ThreadPool(size_t min_threads, size_t max_threads, Mode mode = Mode::fifo);
     ThreadPool(const ThreadPool &) = delete;
     ThreadPool(ThreadPool &&) = delete;
     ThreadPool& operator=(const ThreadPool &) = delete;
     ThreadPool& operator=(ThreadPool &&) = delete;
     template<class F, class... Args>
-    auto enqueue(F&& f, Args&&... args) 
+    auto enqueue(F&& f, Args&&... args)
+        -> std::future<typename std::result_of<F(Args...)>::type>;
+    template<class F, class... Args>
+    void post(F&& f, Args&&... args);
+    template<class F, class... Args>
+    auto submit(F&& f, Args&&... args)
+        -> Future<typename std::result_of<F(Args...)>::type>;
+    Scheduler scheduler();
+    template<class F, class... Args>
+    auto enqueue_priority(Priority priority, F&& f, Args&&... args)
+        -> std::future<typename std::result_of<F(Args...)>::type>;
+    template<class F, class... Args>
+    void post_priority(Priority priority, F&& f, Args&&... args);
+    template<class F, class... Args>
+    auto enqueue_deadline(clock::time_point deadline, F&& f, Args&&... args)
+        -> std::future<typename std::result_of<F(Args...)>::type>;
+    template<class F, class... Args>
+    void post_deadline(clock::time_point deadline, F&& f, Args&&... args);
+    template<class F, class... Args>
+    auto enqueue_on(int cpu, F&& f, Args&&... args)
         -> std::future<typename std::result_of<F(Args...)>::type>;
+    template<class F, class... Args>
+    void post_on(int cpu, F&& f, Args&&... args);
+    template<class It, class F>
+    auto enqueue_bulk(It first, It last, F fn)
+        -> std::vector< std::future<typename std::result_of<F(decltype(*first))>::type> >;
+    template<class F>
+    std::future<void> parallel_for(size_t first, size_t last, size_t grain, F fn);
+    template<class T, class F, class R>
+    std::future<T> parallel_reduce(size_t first, size_t last, size_t grain, T identity, F fn, R reduce);
+    void set_starvation_limit(clock::duration limit);
+    LaneStats lane_stats(Priority priority);
+    LaneStats deadline_stats();
+    void resize(size_t threads);
+    void resize(size_t min_threads, size_t max_threads);
+    void set_keep_alive(clock::duration keep_alive);
+    void set_spawn_threshold(clock::duration threshold);
+    size_t size() const;
+    bool on_worker() const;
+    bool pin_workers(const std::vector<int> &cpus, bool one_per_core = true);
+    static int current_cpu();
     std::vector<unsigned long> ids();
+    CancellationToken token() const;
+    PoolStatsSnapshot stats() const;
+    void shutdown_now();
+    bool drain(clock::duration timeout);
     ~ThreadPool();
 private:
-    // need to keep track of threads so we can join them
-    std::vector< std::thread > workers;
-    // the task queue
-    std::queue< std::function<void()> > tasks;
-    
+    typedef Task task_type;
+
+    struct Worker {
+        Worker() : retired(false), sleeping(false), signaled(false), cpu(-1), node(-1) {}
+        std::thread thread;
+        // only used in work stealing mode
+        WorkStealingDeque<task_type> local;
+        // tasks with an affinity hint for the core this worker is pinned to,
+        // never stolen
+        WorkStealingDeque<task_type> mailbox;
+        // every worker sleeps on its own condition so a wakeup can be aimed
+        // at one worker, the one owning a core or a numa node
+        std::condition_variable wakeup;
+        // the thread has left, the slot can be reused
+        bool retired;
+        // listed in sleepers, guarded by queue_mutex
+        bool sleeping;
+        bool signaled;
+        // the single core it is pinned to and the numa node of all of its
+        // cores, -1 when there is none
+        std::atomic<int> cpu;
+        std::atomic<int> node;
+#if !defined(THREADPOOL_NO_STATS)
+        WorkerCounters counters;
+#endif
+    };
+    typedef std::vector<Worker *> worker_table;
+
+    void worker_main(size_t index);
+    static void run(task_type &task);
+    void run_counted(size_t index, task_type &task);
+    static void stamp(task_type &task);
+    bool wait_for_work(std::unique_lock<std::mutex> &lock, size_t index);
+    bool has_work(const Worker &w) const;
+    bool pop_affine(size_t index, task_type &task);
+    bool pop_urgent(task_type &task);
+    void pop_locked(task_type &task, clock::time_point now);
+    void maybe_spawn(clock::time_point now);
+    void spawn_worker();
+    void retire(size_t index);
+    bool retire_busy(size_t index);
+    Worker &worker(size_t index) const;
+    bool apply_pinning(size_t index);
+    void unplace(size_t index);
+    bool pop_local(size_t index, task_type &task);
+    bool pop_global(size_t index, task_type &task);
+    bool steal(size_t index, task_type &task);
+    void push(task_type &&task, Priority priority = Priority::normal);
+    void push_deadline(task_type &&task, clock::time_point deadline);
+    void push_on(task_type &&task, int cpu);
+    template<class F, class... Args>
+    auto make_task(std::future<typename std::result_of<F(Args...)>::type> &res, F&& f, Args&&... args)
+        -> PromiseTask<typename std::result_of<F(Args...)>::type, decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...))>;
+    void push_bulk(std::vector<task_type> &batch);
+    static void post_task(void *pool, Task &&task);
+    void enter_ring();
+    void leave_ring();
+    void notify_ring(size_t count);
+    void take_all(std::vector<task_type> &dropped);
+    size_t cancel_queued();
+    void join_all();
+    bool wake_one();
+    void wake(size_t count);
+    void wake_all();
+    void wake_worker(size_t index);
+    void wake_node(int node);
+
+    template<class State>
+    void submit_range(const std::shared_ptr<State> &state, size_t first, size_t last);
+    template<class State>
+    void run_range(const std::shared_ptr<State> &state, size_t first, size_t last);
+    template<class State> struct RangeTask;
+    template<class F> struct ForState;
+    template<class T, class F, class R> struct ReduceState;
+
+    // index of the calling thread in this pool, or -1 for outside threads
+    long current_index() const;
+    static const ThreadPool *&current_pool();
+    static long &current_worker();
+
+    // need to keep track of threads so we can join them. slots are reused
+    // after a worker retires but never freed before the pool
+    std::vector< std::unique_ptr<Worker> > slots;
+    // thieves read the slots through a published copy, growing the pool
+    // publishes a new copy and keeps the old one alive
+    std::vector< std::unique_ptr<worker_table> > tables;
+    std::atomic<worker_table *> table;
+    // the task queue, in work stealing mode it is the global injection queue
+    LaneQueue tasks;
+    // normal priority tasks in lock_free mode, popped without queue_mutex
+    MpmcQueue<task_type> ring;
+
     // synchronization
     std::mutex queue_mutex;
-    std::condition_variable condition;
-    bool stop;
+    // sleeping workers, the most recently idle one is woken first
+    std::vector<size_t> sleepers;
+    std::atomic<bool> stop;
+    // producers between their stop check and their push to the ring, workers
+    // of a stopped pool wait for them so no task is left behind
+    std::atomic<size_t> ring_producers;
+    // signalled when the last worker has left after stop
+    std::condition_variable stopped;
+    // cancelled by shutdown_now() and by a drain() that ran out of time
+    CancellationSource cancellation;
+    Mode mode;
+    // tasks sitting in the per worker deques
+    std::atomic<size_t> pending;
+    // workers looking for work or asleep
+    std::atomic<size_t> idle;
+    // deadline and high priority tasks in the shared queue
+    std::atomic<size_t> urgent;
+    // running workers and their bounds
+    std::atomic<size_t> live;
+    std::atomic<size_t> min_threads;
+    std::atomic<size_t> max_threads;
+    // an elastic pool retires workers idle for keep_alive and spawns one
+    // when the oldest queued task has waited spawn_threshold
+    clock::duration keep_alive;
+    clock::duration spawn_threshold;
+    // placement set by pin_workers, all guarded by queue_mutex. node_queues
+    // is filled once and never changes afterwards, workers read it unlocked
+    std::vector<int> pin_cpus;
+    bool pin_one_per_core;
+    std::vector<int> cpu_nodes;
+    std::vector<long> cpu_owner;
+    std::vector<size_t> node_workers;
+    std::vector< std::unique_ptr< WorkStealingDeque<task_type> > > node_queues;
 };
- 
+
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads)
-    :   stop(false)
+inline ThreadPool::ThreadPool(size_t threads, Mode mode)
+    :   ThreadPool(threads, threads, mode)
 {
-    for(size_t i = 0;i<threads;++i)
-        workers.emplace_back(
-            [this]
-            {
-                for(;;)
-                {
-                    std::function<void()> task;
-
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock,
-                            [this]{ return this->stop || !this->tasks.empty(); });
-                        if(this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-
-                    task();
-                }
-            }
-        );
+}
+
+// an elastic pool keeps min_threads workers and grows up to max_threads
+// while work is backing up
+inline ThreadPool::ThreadPool(size_t min_threads, size_t max_threads, Mode mode)
+    :   table(nullptr), ring(mode == Mode::lock_free ? 1024 : 2), stop(false), ring_producers(0), mode(mode), pending(0), idle(0), urgent(0), live(0),
+        min_threads(min_threads), max_threads(max_threads < min_threads ? min_threads : max_threads),
+        keep_alive(std::chrono::seconds(60)), spawn_threshold(std::chrono::milliseconds(10)),
+        pin_one_per_core(false)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while(live < min_threads)
+        spawn_worker();
+}
+
+inline void ThreadPool::worker_main(size_t index)
+{
+    current_pool() = this;
+    current_worker() = (long)index;
+
+    for(;;)
+    {
+        task_type task;
+
+        bool found = pop_affine(index, task);
+        // deadline and high priority work goes before our own backlog
+        if(!found && mode == Mode::work_stealing)
+            found = (urgent > 0 && pop_global(index, task))
+                || pop_local(index, task) || pop_global(index, task) || steal(index, task);
+        // the ring before the lanes, low priority work waits for it to drain
+        if(!found && mode == Mode::lock_free)
+            found = (urgent > 0 && pop_urgent(task)) || ring.try_pop(task);
+
+        if(!found)
+        {
+            // blocks freed here go back where enqueue() can reuse them
+            BlockCacheList::release();
+            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            if(!wait_for_work(lock, index))
+                return;
+            if(mode == Mode::work_stealing || this->tasks.empty())
+                continue;
+            pop_locked(task, clock::now());
+        }
+
+        run_counted(index, task);
+        if(live > max_threads && retire_busy(index))
+            return;
+    }
+}
+
+// returns true once there is something to do, false when the worker has to
+// leave, either because the pool stops or because it was retired
+inline bool ThreadPool::wait_for_work(std::unique_lock<std::mutex> &lock, size_t index)
+{
+    Worker &w = *slots[index];
+
+    // idle must be published before the queues are checked, push() does the
+    // mirror image so one of the two always sees the other
+    ++idle;
+    for(;;)
+    {
+        if(!stop && live > max_threads)
+            break;
+        if(has_work(w))
+        {
+            --idle;
+            return true;
+        }
+        if(stop && ring_producers == 0)
+        {
+            --idle;
+            if(--live == 0)
+                stopped.notify_all();
+            return false;
+        }
+
+        w.sleeping = true;
+        w.signaled = false;
+        sleepers.push_back(index);
+        bool woken = true;
+#if !defined(THREADPOOL_NO_STATS)
+        clock::time_point asleep = clock::now();
+#endif
+        if(live > min_threads)
+            woken = w.wakeup.wait_for(lock, keep_alive, [&w]{ return w.signaled; });
+        else
+            w.wakeup.wait(lock, [&w]{ return w.signaled; });
+#if !defined(THREADPOOL_NO_STATS)
+        w.counters.idled(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - asleep).count());
+#endif
+        if(w.sleeping)
+        {
+            // timed out, nobody took us off the list
+            sleepers.erase(std::find(sleepers.begin(), sleepers.end(), index));
+            w.sleeping = false;
+        }
+        if(!woken && !has_work(w) && live > min_threads)
+            break;
+    }
+    --idle;
+    retire(index);
+    return false;
+}
+
+inline bool ThreadPool::has_work(const Worker &w) const
+{
+    if(!tasks.empty() || pending > 0 || !ring.empty() || w.mailbox.size() > 0)
+        return true;
+    int node = w.node;
+    return node >= 0 && node_queues[node]->size() > 0;
+}
+
+inline bool ThreadPool::pop_urgent(task_type &task)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if(tasks.urgent() == 0)
+        return false;
+    pop_locked(task, clock::now());
+    return true;
+}
+
+// tasks routed to this worker by an affinity hint, then the ones for its node
+inline bool ThreadPool::pop_affine(size_t index, task_type &task)
+{
+    Worker &w = worker(index);
+    if(w.mailbox.pop_front(task))
+        return true;
+    int node = w.node;
+    return node >= 0 && node_queues[node]->pop_front(task);
+}
+
+inline void ThreadPool::pop_locked(task_type &task, clock::time_point now)
+{
+    tasks.pop(task, now);
+    urgent = tasks.urgent();
+    maybe_spawn(now);
+}
+
+// called under queue_mutex whenever the shared queue changes
+inline void ThreadPool::maybe_spawn(clock::time_point now)
+{
+    if(live >= max_threads || idle > 0 || stop || (tasks.empty() && ring.empty()))
+        return;
+    // the ring keeps no enqueue times, a backlog bigger than the pool has to do
+    if(live == 0 || live < min_threads || (!tasks.empty() && now - tasks.oldest() >= spawn_threshold)
+        || ring.size() > live)
+    {
+        try
+        {
+            spawn_worker();
+        }
+        catch(...)
+        {
+            // out of threads, the workers we have will get there
+        }
+    }
+}
+
+inline void ThreadPool::spawn_worker()
+{
+    size_t index = 0;
+    while(index < slots.size() && !slots[index]->retired)
+        ++index;
+
+    if(index == slots.size())
+    {
+        slots.emplace_back(new Worker());
+        tables.emplace_back(new worker_table());
+        for(auto &slot : slots)
+            tables.back()->push_back(slot.get());
+        table.store(tables.back().get(), std::memory_order_release);
+        // room for every worker to sleep, so going idle never allocates
+        sleepers.reserve(slots.size());
+    }
+
+    Worker &w = *slots[index];
+    // a retired thread has already given up the lock and is on its way out
+    if(w.thread.joinable())
+        w.thread.join();
+    w.thread = std::thread(&ThreadPool::worker_main, this, index);
+    w.retired = false;
+    ++live;
+    if(!pin_cpus.empty())
+        apply_pinning(index);
+}
+
+// under queue_mutex. whatever is parked on the worker goes back to the
+// shared queue so nothing is stranded on a thread that is gone
+inline void ThreadPool::retire(size_t index)
+{
+    Worker &w = *slots[index];
+    --live;
+    w.retired = true;
+
+    clock::time_point now = clock::now();
+    size_t moved = 0;
+    task_type task;
+    while(w.local.pop_front(task))
+    {
+        --pending;
+        tasks.push(std::move(task), Priority::normal, now);
+        ++moved;
+    }
+    while(w.mailbox.pop_front(task))
+    {
+        tasks.push(std::move(task), Priority::normal, now);
+        ++moved;
+    }
+    int node = w.node;
+    unplace(index);
+    if(node >= 0 && node_workers[node] == 0)
+    {
+        while(node_queues[node]->pop_front(task))
+        {
+            tasks.push(std::move(task), Priority::normal, now);
+            ++moved;
+        }
+    }
+    if(moved)
+    {
+        urgent = tasks.urgent();
+        wake(moved);
+    }
+}
+
+// shrinking while busy, leave between two tasks
+inline bool ThreadPool::retire_busy(size_t index)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if(stop || live <= max_threads)
+        return false;
+    retire(index);
+    return true;
+}
+
+inline ThreadPool::Worker &ThreadPool::worker(size_t index) const
+{
+    return *(*table.load(std::memory_order_acquire))[index];
+}
+
+// under queue_mutex, pin one worker following the pin_workers() settings
+inline bool ThreadPool::apply_pinning(size_t index)
+{
+    Worker &w = *slots[index];
+    std::vector<int> cpus;
+    if(pin_one_per_core)
+        cpus.push_back(pin_cpus[index % pin_cpus.size()]);
+    else
+        cpus = pin_cpus;
+
+    unplace(index);
+    if(!CpuTopology::pin(w.thread, cpus))
+        return false;
+
+    int node = cpu_nodes[cpus[0]];
+    for(int cpu : cpus)
+        if(cpu_nodes[cpu] != node)
+            node = -1;
+    if(cpus.size() == 1)
+    {
+        w.cpu = cpus[0];
+        cpu_owner[cpus[0]] = (long)index;
+    }
+    if(node >= 0)
+    {
+        w.node = node;
+        ++node_workers[node];
+    }
+    return true;
+}
+
+// under queue_mutex, forget where a worker runs
+inline void ThreadPool::unplace(size_t index)
+{
+    Worker &w = *slots[index];
+    int cpu = w.cpu, node = w.node;
+    if(cpu >= 0 && cpu_owner[cpu] == (long)index)
+        cpu_owner[cpu] = -1;
+    if(node >= 0)
+        --node_workers[node];
+    w.cpu = -1;
+    w.node = -1;
+}
+
+// enqueue() reports exceptions through the future, a posted task has no one
+// to report to so whatever escapes it is dropped like an unread future
+inline void ThreadPool::run(task_type &task)
+{
+    try
+    {
+        task();
+    }
+    catch(...)
+    {
+    }
+    task.reset();
+}
+
+// run() plus the statistics of the worker
+inline void ThreadPool::run_counted(size_t index, task_type &task)
+{
+#if defined(THREADPOOL_NO_STATS)
+    (void)index;
+    run(task);
+#else
+    // what is still queued behind this task, an estimate
+    size_t depth = tasks.size() + ring.size() + pending;
+    long long queued = task.get_enqueued();
+    long long start = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+    run(task);
+    long long end = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+    worker(index).counters.task_done(start > queued ? start - queued : 0, end - start, depth);
+#endif
+}
+
+inline void ThreadPool::stamp(task_type &task)
+{
+#if defined(THREADPOOL_NO_STATS)
+    (void)task;
+#else
+    task.set_enqueued(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count());
+#endif
+}
+
+inline bool ThreadPool::pop_local(size_t index, task_type &task)
+{
+    if(!worker(index).local.pop(task))
+        return false;
+    --pending;
+    return true;
+}
+
+// take a slice of the global queue, keep one task and park the rest in the
+// local deque so the next few pops do not touch queue_mutex. only ordinary
+// work is parked, priority and deadline tasks stay where they are ordered.
+inline bool ThreadPool::pop_global(size_t index, task_type &task)
+{
+    clock::time_point now = clock::now();
+    std::unique_lock<std::mutex> lock(this->queue_mutex);
+    if(!this->tasks.pop(task, now))
+        return false;
+    maybe_spawn(now);
+
+    size_t batch = this->tasks.urgent() ? 0 : this->tasks.normal_size() / live;
+    if(batch > 32)
+        batch = 32;
+    // pushed in reverse so the LIFO end of the deque still hands them out
+    // in the order they were enqueued
+    task_type parked[32];
+    for(size_t i = 0; i < batch; ++i)
+        this->tasks.pop_normal(parked[batch - 1 - i], now);
+    worker(index).local.push_bulk(parked, parked + batch);
+    pending += batch;
+    urgent = this->tasks.urgent();
+    return true;
+}
+
+// walk the other workers starting from a random victim
+inline bool ThreadPool::steal(size_t index, task_type &task)
+{
+    if(pending == 0)
+        return false;
+
+    static thread_local unsigned int seed = (unsigned int)(index * 2654435761u + 1);
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+
+    const worker_table &victims = *table.load(std::memory_order_acquire);
+    size_t count = victims.size();
+    size_t start = seed % count;
+    for(size_t i = 0; i < count; ++i)
+    {
+        size_t victim = (start + i) % count;
+        if(victim != index && victims[victim]->local.steal(task))
+        {
+            --pending;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ThreadPool::push(task_type &&task, Priority priority)
+{
+    stamp(task);
+    if(mode == Mode::lock_free && priority == Priority::normal)
+    {
+        enter_ring();
+        ring.push(std::move(task));
+        notify_ring(1);
+        leave_ring();
+        return;
+    }
+
+    long index = current_index();
+    if(index < 0 || priority != Priority::normal)
+    {
+        clock::time_point now = clock::now();
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+
+            // don't allow enqueueing after stopping the pool
+            if(stop)
+                throw std::runtime_error("enqueue on stopped ThreadPool");
+
+            tasks.push(std::move(task), priority, now);
+            urgent = tasks.urgent();
+            maybe_spawn(now);
+            wake_one();
+        }
+        return;
+    }
+
+    // called from one of our own workers, stay local and lock free
+    if(stop)
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    worker(index).local.push(std::move(task));
+    ++pending;
+    if(idle > 0)
+    {
+        // an idle worker may be between its check and the wait, taking the
+        // mutex orders us after it
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        wake_one();
+    }
+}
+
+inline void ThreadPool::push_deadline(task_type &&task, clock::time_point deadline)
+{
+    stamp(task);
+    clock::time_point now = clock::now();
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+
+        if(stop)
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+
+        tasks.push_deadline(std::move(task), deadline, now);
+        urgent = tasks.urgent();
+        maybe_spawn(now);
+        wake_one();
+    }
+}
+
+// the worker pinned to the core, else a worker on the same numa node, else
+// whoever is free
+inline void ThreadPool::push_on(task_type &&task, int cpu)
+{
+    stamp(task);
+    clock::time_point now = clock::now();
+    std::unique_lock<std::mutex> lock(queue_mutex);
+
+    if(stop)
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+
+    if(cpu >= 0 && (size_t)cpu < cpu_owner.size())
+    {
+        long owner = cpu_owner[cpu];
+        if(owner >= 0)
+        {
+            slots[owner]->mailbox.push(std::move(task));
+            wake_worker(owner);
+            return;
+        }
+        int node = cpu_nodes[cpu];
+        if(node_workers[node] > 0)
+        {
+            node_queues[node]->push(std::move(task));
+            wake_node(node);
+            return;
+        }
+    }
+
+    tasks.push(std::move(task), Priority::normal, now);
+    urgent = tasks.urgent();
+    maybe_spawn(now);
+    wake_one();
+}
+
+// one lock for the whole batch, and only as many wakeups as there are
+// sleeping workers to take the new tasks
+inline void ThreadPool::push_bulk(std::vector<task_type> &batch)
+{
+    if(batch.empty())
+        return;
+    stamp(batch[0]);
+    for(auto &task : batch)
+        task.set_enqueued(batch[0].get_enqueued());
+
+    if(mode == Mode::lock_free)
+    {
+        enter_ring();
+        for(auto &task : batch)
+            ring.push(std::move(task));
+        notify_ring(batch.size());
+        leave_ring();
+        return;
+    }
+
+    long index = current_index();
+    if(index < 0)
+    {
+        clock::time_point now = clock::now();
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+
+            if(stop)
+                throw std::runtime_error("enqueue on stopped ThreadPool");
+
+            for(auto &task : batch)
+                tasks.push(std::move(task), Priority::normal, now);
+            maybe_spawn(now);
+            wake(batch.size());
+        }
+        return;
+    }
+
+    if(stop)
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    worker(index).local.push_bulk(batch.begin(), batch.end());
+    pending += batch.size();
+    if(idle > 0)
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        wake(batch.size());
+    }
+}
+
+// the stop check of a push to the ring. the producer is counted before stop
+// is read and wait_for_work() reads the count after stop was set, so either
+// the push is refused or the workers stay until it has landed
+inline void ThreadPool::enter_ring()
+{
+    ++ring_producers;
+    if(stop)
+    {
+        leave_ring();
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+    }
+}
+
+inline void ThreadPool::leave_ring()
+{
+    // the last producer out lets the workers of a stopped pool leave
+    if(--ring_producers == 0 && stop)
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        wake_all();
+    }
+}
+
+// after a push to the ring. pairs with ++idle in wait_for_work(), the lock
+// is only taken when a worker may be asleep or the pool may have to grow
+inline void ThreadPool::notify_ring(size_t count)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(idle == 0 && live >= max_threads)
+        return;
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    maybe_spawn(clock::now());
+    wake(count);
+}
+
+// the wake functions run under queue_mutex
+inline bool ThreadPool::wake_one()
+{
+    if(sleepers.empty())
+        return false;
+    wake_worker(sleepers.back());
+    return true;
+}
+
+inline void ThreadPool::wake(size_t count)
+{
+    while(count-- && wake_one())
+        ;
+}
+
+inline void ThreadPool::wake_all()
+{
+    while(wake_one())
+        ;
+}
+
+inline void ThreadPool::wake_worker(size_t index)
+{
+    Worker &w = *slots[index];
+    if(!w.sleeping)
+        return;
+    sleepers.erase(std::find(sleepers.begin(), sleepers.end(), index));
+    w.sleeping = false;
+    w.signaled = true;
+    w.wakeup.notify_one();
+}
+
+inline void ThreadPool::wake_node(int node)
+{
+    for(size_t i = sleepers.size(); i-- > 0;)
+    {
+        if(slots[sleepers[i]]->node == node)
+        {
+            wake_worker(sleepers[i]);
+            return;
+        }
+    }
+}
+
+inline long ThreadPool::current_index() const
+{
+    if(mode != Mode::work_stealing || current_pool() != this)
+        return -1;
+    return current_worker();
+}
+
+inline const ThreadPool *&ThreadPool::current_pool()
+{
+    static thread_local const ThreadPool *pool = nullptr;
+    return pool;
+}
+
+inline long &ThreadPool::current_worker()
+{
+    static thread_local long index = -1;
+    return index;
 }
 
 // add new work item to the pool
 template<class F, class... Args>
-auto ThreadPool::enqueue(F&& f, Args&&... args) 
+auto ThreadPool::enqueue(F&& f, Args&&... args)
     -> std::future<typename std::result_of<F(Args...)>::type>
+{
+    std::future<typename std::result_of<F(Args...)>::type> res;
+    push(make_task(res, std::forward<F>(f), std::forward<Args>(args)...));
+    return res;
+}
+
+// the shared state comes from a per thread block cache and the task is
+// stored inline, small tasks never reach the heap
+template<class F, class... Args>
+auto ThreadPool::make_task(std::future<typename std::result_of<F(Args...)>::type> &res, F&& f, Args&&... args)
+    -> PromiseTask<typename std::result_of<F(Args...)>::type, decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...))>
 {
     using return_type = typename std::result_of<F(Args...)>::type;
+    typedef decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...)) bound_type;
+
+    std::promise<return_type> promise(std::allocator_arg, PooledAllocator<char>());
+    res = promise.get_future();
+    return PromiseTask<return_type, bound_type>(std::move(promise),
+        std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+}
+
+// fire and forget, no future and no shared state
+template<class F, class... Args>
+void ThreadPool::post(F&& f, Args&&... args)
+{
+    push(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+}
+
+// same as enqueue, but the task waits in the lane of the given priority
+template<class F, class... Args>
+auto ThreadPool::enqueue_priority(Priority priority, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type>
+{
+    std::future<typename std::result_of<F(Args...)>::type> res;
+    push(make_task(res, std::forward<F>(f), std::forward<Args>(args)...), priority);
+    return res;
+}
+
+template<class F, class... Args>
+void ThreadPool::post_priority(Priority priority, F&& f, Args&&... args)
+{
+    push(std::bind(std::forward<F>(f), std::forward<Args>(args)...), priority);
+}
+
+// like enqueue() but the future can be chained with then(), when_all() and
+// when_any() without blocking a worker
+template<class F, class... Args>
+auto ThreadPool::submit(F&& f, Args&&... args)
+    -> Future<typename std::result_of<F(Args...)>::type>
+{
+    typedef typename std::result_of<F(Args...)>::type return_type;
+    typedef decltype(std::bind(std::forward<F>(f), std::forward<Args>(args)...)) bound_type;
+
+    std::shared_ptr< FutureState<return_type> > state = std::make_shared< FutureState<return_type> >(scheduler());
+    push(FutureTask<return_type, bound_type>(state, std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
+    return Future<return_type>(state);
+}
+
+// continuations scheduled with this run on the pool, for Promise and TaskGraph
+inline Scheduler ThreadPool::scheduler()
+{
+    return Scheduler(&ThreadPool::post_task, this);
+}
+
+inline void ThreadPool::post_task(void *pool, Task &&task)
+{
+    static_cast<ThreadPool *>(pool)->push(std::move(task));
+}
 
-    auto task = std::make_shared< std::packaged_task<return_type()> >(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
-        );
-        
-    std::future<return_type> res = task->get_future();
+// run on the worker pinned to cpu, or at least on its numa node, see
+// pin_workers(). without pinning this is a plain enqueue
+template<class F, class... Args>
+auto ThreadPool::enqueue_on(int cpu, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type>
+{
+    std::future<typename std::result_of<F(Args...)>::type> res;
+    push_on(make_task(res, std::forward<F>(f), std::forward<Args>(args)...), cpu);
+    return res;
+}
+
+template<class F, class... Args>
+void ThreadPool::post_on(int cpu, F&& f, Args&&... args)
+{
+    push_on(std::bind(std::forward<F>(f), std::forward<Args>(args)...), cpu);
+}
+
+// tasks with a deadline run before any lane, earliest deadline first
+template<class F, class... Args>
+auto ThreadPool::enqueue_deadline(clock::time_point deadline, F&& f, Args&&... args)
+    -> std::future<typename std::result_of<F(Args...)>::type>
+{
+    std::future<typename std::result_of<F(Args...)>::type> res;
+    push_deadline(make_task(res, std::forward<F>(f), std::forward<Args>(args)...), deadline);
+    return res;
+}
+
+template<class F, class... Args>
+void ThreadPool::post_deadline(clock::time_point deadline, F&& f, Args&&... args)
+{
+    push_deadline(std::bind(std::forward<F>(f), std::forward<Args>(args)...), deadline);
+}
+
+// one task per element, all submitted under a single lock
+template<class It, class F>
+auto ThreadPool::enqueue_bulk(It first, It last, F fn)
+    -> std::vector< std::future<typename std::result_of<F(decltype(*first))>::type> >
+{
+    using return_type = typename std::result_of<F(decltype(*first))>::type;
+    typedef typename std::decay<decltype(*first)>::type value_type;
+    typedef decltype(std::bind(fn, std::declval<value_type>())) bound_type;
+
+    std::vector< std::future<return_type> > results;
+    std::vector<task_type> batch;
+    for(; first != last; ++first)
     {
-        std::unique_lock<std::mutex> lock(queue_mutex);
+        std::promise<return_type> promise(std::allocator_arg, PooledAllocator<char>());
+        results.emplace_back(promise.get_future());
+        batch.emplace_back(PromiseTask<return_type, bound_type>(std::move(promise),
+            std::bind(fn, value_type(*first))));
+    }
+    push_bulk(batch);
+    return results;
+}
 
-        // don't allow enqueueing after stopping the pool
-        if(stop)
-            throw std::runtime_error("enqueue on stopped ThreadPool");
+// one piece of a parallel_for/parallel_reduce range. when the piece is
+// dropped by shutdown_now() its count still goes down so the future
+// completes, with TaskCancelled
+template<class State>
+struct ThreadPool::RangeTask {
+    RangeTask(ThreadPool *pool, const std::shared_ptr<State> &state, size_t first, size_t last)
+        : pool(pool), state(state), first(first), last(last) {}
+
+    void operator()() { pool->run_range(state, first, last); }
+
+    void cancel()
+    {
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            if(!state->error)
+                state->error = std::make_exception_ptr(TaskCancelled());
+        }
+        if(state->remaining.fetch_sub(last - first) == last - first)
+            state->finish();
+    }
+
+    ThreadPool *pool;
+    std::shared_ptr<State> state;
+    size_t first;
+    size_t last;
+};
 
-        tasks.emplace([task](){ (*task)(); });
+template<class F>
+struct ThreadPool::ForState {
+    ForState(size_t count, size_t grain, F &&fn) : remaining(count), grain(grain), fn(std::move(fn)) {}
+
+    void run(size_t first, size_t last)
+    {
+        try
+        {
+            for(size_t i = first; i < last; ++i)
+                fn(i);
+        }
+        catch(...)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(!error)
+                error = std::current_exception();
+        }
+    }
+
+    void finish()
+    {
+        if(error)
+            done.set_exception(error);
+        else
+            done.set_value();
+    }
+
+    std::atomic<size_t> remaining;
+    size_t grain;
+    F fn;
+    std::mutex mutex;
+    std::exception_ptr error;
+    std::promise<void> done;
+};
+
+template<class T, class F, class R>
+struct ThreadPool::ReduceState {
+    ReduceState(size_t count, size_t grain, T identity, F &&fn, R &&reduce)
+        : remaining(count), grain(grain), fn(std::move(fn)), reduce(std::move(reduce)), identity(identity), result(identity) {}
+
+    void run(size_t first, size_t last)
+    {
+        try
+        {
+            T partial = identity;
+            for(size_t i = first; i < last; ++i)
+                partial = reduce(partial, fn(i));
+            std::unique_lock<std::mutex> lock(mutex);
+            result = reduce(result, partial);
+        }
+        catch(...)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if(!error)
+                error = std::current_exception();
+        }
     }
-    condition.notify_one();
+
+    void finish()
+    {
+        if(error)
+            done.set_exception(error);
+        else
+            done.set_value(result);
+    }
+
+    std::atomic<size_t> remaining;
+    size_t grain;
+    F fn;
+    R reduce;
+    T identity;
+    std::mutex mutex;
+    T result;
+    std::exception_ptr error;
+    std::promise<T> done;
+};
+
+// cut the range into a few pieces per worker, the pieces split further
+// while running if workers go idle
+template<class State>
+void ThreadPool::submit_range(const std::shared_ptr<State> &state, size_t first, size_t last)
+{
+    size_t count = last - first;
+    size_t pieces = (live ? live.load() : 1) * 4;
+    if(pieces > (count + state->grain - 1) / state->grain)
+        pieces = (count + state->grain - 1) / state->grain;
+    if(pieces == 0)
+        pieces = 1;
+
+    std::vector<task_type> batch;
+    size_t step = count / pieces, extra = count % pieces;
+    for(size_t i = 0; i < pieces; ++i)
+    {
+        size_t end = first + step + (i < extra ? 1 : 0);
+        batch.emplace_back(RangeTask<State>(this, state, first, end));
+        first = end;
+    }
+    push_bulk(batch);
+}
+
+template<class State>
+void ThreadPool::run_range(const std::shared_ptr<State> &state, size_t first, size_t last)
+{
+    while(first < last)
+    {
+        // hand the upper half to an idle worker, if nobody is idle keep
+        // going grain by grain and look again
+        while(last - first > state->grain && idle > 0 && !stop)
+        {
+            size_t middle = first + (last - first) / 2;
+            try
+            {
+                push(RangeTask<State>(this, state, middle, last));
+            }
+            catch(...)
+            {
+                // stopping, keep the whole range
+                break;
+            }
+            last = middle;
+        }
+
+        size_t end = last - first > state->grain ? first + state->grain : last;
+        state->run(first, end);
+        if(state->remaining.fetch_sub(end - first) == end - first)
+            state->finish();
+        first = end;
+    }
+}
+
+// call fn(i) for every i in [first, last), the future is ready once all of
+// them have returned and carries the first exception thrown, if any
+template<class F>
+std::future<void> ThreadPool::parallel_for(size_t first, size_t last, size_t grain, F fn)
+{
+    auto state = std::make_shared< ForState<F> >(last > first ? last - first : 0, grain ? grain : 1, std::move(fn));
+    std::future<void> res = state->done.get_future();
+    if(last <= first)
+        state->finish();
+    else
+        submit_range(state, first, last);
     return res;
 }
 
+// reduce(identity, fn(i)) over [first, last). partial results are combined
+// in no particular order so reduce must be associative and commutative
+template<class T, class F, class R>
+std::future<T> ThreadPool::parallel_reduce(size_t first, size_t last, size_t grain, T identity, F fn, R reduce)
+{
+    auto state = std::make_shared< ReduceState<T, F, R> >(last > first ? last - first : 0, grain ? grain : 1,
+        identity, std::move(fn), std::move(reduce));
+    std::future<T> res = state->done.get_future();
+    if(last <= first)
+        state->finish();
+    else
+        submit_range(state, first, last);
+    return res;
+}
+
+// a queued task older than this is served next whatever its lane
+inline void ThreadPool::set_starvation_limit(clock::duration limit)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    tasks.set_starvation_limit(limit);
+}
+
+inline LaneStats ThreadPool::lane_stats(Priority priority)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    return tasks.lane_stats(priority);
+}
+
+inline LaneStats ThreadPool::deadline_stats()
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    return tasks.deadline_stats();
+}
+
+inline void ThreadPool::resize(size_t threads)
+{
+    resize(threads, threads);
+}
+
+// workers above the new maximum leave as soon as they are between tasks,
+// missing ones up to the new minimum start right away
+inline void ThreadPool::resize(size_t min_threads, size_t max_threads)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if(stop)
+        return;
+    this->min_threads = min_threads;
+    this->max_threads = max_threads < min_threads ? min_threads : max_threads;
+    while(live < this->min_threads)
+        spawn_worker();
+    if(live > this->max_threads)
+        wake_all();
+    maybe_spawn(clock::now());
+}
+
+inline void ThreadPool::set_keep_alive(clock::duration keep_alive)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    this->keep_alive = keep_alive;
+}
+
+inline void ThreadPool::set_spawn_threshold(clock::duration threshold)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    spawn_threshold = threshold;
+}
+
+// workers running right now
+inline size_t ThreadPool::size() const
+{
+    return live;
+}
+
+// true on the pool's own workers. code that may run on them must not wait for
+// work of the same pool, with every worker waiting nothing would run it
+inline bool ThreadPool::on_worker() const
+{
+    return current_pool() == this;
+}
+
+// pin the workers to the given cpus, one cpu each in turn (one_per_core) or
+// all of them to the whole set. workers started later are pinned the same
+// way. linux only, returns false where pinning is not supported.
+inline bool ThreadPool::pin_workers(const std::vector<int> &cpus, bool one_per_core)
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    if(cpus.empty() || stop)
+        return false;
+
+    if(node_queues.empty())
+    {
+        cpu_nodes = CpuTopology::cpu_nodes();
+        int nodes = cpu_nodes.empty() ? 1 : 1 + *std::max_element(cpu_nodes.begin(), cpu_nodes.end());
+        cpu_owner.assign(cpu_nodes.size(), -1);
+        node_workers.assign(nodes, 0);
+        for(int i = 0; i < nodes; ++i)
+            node_queues.emplace_back(new WorkStealingDeque<task_type>());
+    }
+    for(int cpu : cpus)
+        if(cpu < 0 || (size_t)cpu >= cpu_nodes.size())
+            return false;
+
+    pin_cpus = cpus;
+    pin_one_per_core = one_per_core;
+    bool pinned = true;
+    for(size_t i = 0; i < slots.size(); ++i)
+        if(!slots[i]->retired)
+            pinned = apply_pinning(i) && pinned;
+    return pinned;
+}
+
+// handy to pick the hint for enqueue_on from the thread that owns the data
+inline int ThreadPool::current_cpu()
+{
+    return CpuTopology::current_cpu();
+}
+
 //get all thread ids
 inline std::vector<unsigned long> ThreadPool::ids()
 {
     std::vector<unsigned long> result;
     if (stop) return std::move(result);
-    for (decltype(workers.size()) i=0; i < workers.size(); i++)
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    for (decltype(slots.size()) i=0; i < slots.size(); i++)
     {
+        if (slots[i]->retired) continue;
         std::stringstream s;
         unsigned long threadid;
-        s << workers[i].get_id();
+        s << slots[i]->thread.get_id();
         s >> threadid;
         result.emplace_back(threadid);
     }
     return std::move(result);
 }
 
+// counters of every worker slot and their sum, see PoolStats.h
+inline PoolStatsSnapshot ThreadPool::stats() const
+{
+    PoolStatsSnapshot result;
+    result.threads = live;
+#if !defined(THREADPOOL_NO_STATS)
+    const worker_table *workers = table.load(std::memory_order_acquire);
+    if(workers)
+    {
+        for(Worker *w : *workers)
+        {
+            result.workers.push_back(w->counters.snapshot());
+            result.total.merge(result.workers.back());
+        }
+    }
+#endif
+    return result;
+}
+
+// polled by long running tasks, cancelled when the pool shuts down early
+inline CancellationToken ThreadPool::token() const
+{
+    return cancellation.token();
+}
+
+// stop now: queued tasks are dropped and their futures hold TaskCancelled,
+// running tasks see token() cancelled and are waited for. must not be
+// called from one of the workers.
+inline void ThreadPool::shutdown_now()
+{
+    cancellation.cancel();
+    cancel_queued();
+    join_all();
+}
+
+// stop taking tasks and let the queued ones run for at most timeout, then
+// shut down like shutdown_now(). returns true if everything queued ran.
+// must not be called from one of the workers.
+inline bool ThreadPool::drain(clock::duration timeout)
+{
+    bool finished;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        stop = true;
+        wake_all();
+        finished = stopped.wait_for(lock, timeout, [this] { return live == 0; });
+    }
+    if(!finished)
+        cancellation.cancel();
+    // with no worker left anything still queued would never run
+    if(cancel_queued() > 0)
+        finished = false;
+    join_all();
+    return finished;
+}
+
+// under queue_mutex, empty every queue of the pool
+inline void ThreadPool::take_all(std::vector<task_type> &dropped)
+{
+    clock::time_point now = clock::now();
+    task_type task;
+    while(tasks.pop(task, now))
+        dropped.push_back(std::move(task));
+    urgent = 0;
+    while(ring.try_pop(task))
+        dropped.push_back(std::move(task));
+    for(auto &slot : slots)
+    {
+        while(slot->local.pop_front(task))
+        {
+            --pending;
+            dropped.push_back(std::move(task));
+        }
+        while(slot->mailbox.pop_front(task))
+            dropped.push_back(std::move(task));
+    }
+    for(auto &queue : node_queues)
+        while(queue->pop_front(task))
+            dropped.push_back(std::move(task));
+}
+
+inline size_t ThreadPool::cancel_queued()
+{
+    std::vector<task_type> dropped;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        stop = true;
+        take_all(dropped);
+        wake_all();
+    }
+    // outside the lock, cancelling completes futures and their callbacks
+    // may try to post
+    for(auto &task : dropped)
+        task.cancel();
+    return dropped.size();
+}
+
+inline void ThreadPool::join_all()
+{
+    for(auto &slot: slots)
+        if(slot->thread.joinable())
+            slot->thread.join();
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool()
 {
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
         stop = true;
+        wake_all();
     }
-    condition.notify_all();
-    for(std::thread &worker: workers)
-        worker.join();
+    join_all();
 }
 
 #endif
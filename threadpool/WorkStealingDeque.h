@@ -0,0 +1,130 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <utility>
+
+// growable ring buffer, the storage is never shrunk so a queue that has
+// reached its working size stops allocating
+template<class T>
+class RingDeque {
+public:
+    RingDeque() : head(0), count(0) {}
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    void push_back(T &&value)
+    {
+        if(count == buffer.size())
+            grow();
+        buffer[(head + count) & (buffer.size() - 1)] = std::move(value);
+        ++count;
+    }
+
+    T pop_back()
+    {
+        --count;
+        return std::move(buffer[(head + count) & (buffer.size() - 1)]);
+    }
+
+    T pop_front()
+    {
+        T value = std::move(buffer[head]);
+        head = (head + 1) & (buffer.size() - 1);
+        --count;
+        return value;
+    }
+
+    T &front() { return buffer[head]; }
+    const T &front() const { return buffer[head]; }
+
+private:
+    void grow()
+    {
+        std::vector<T> bigger(buffer.empty() ? 16 : buffer.size() * 2);
+        for(size_t i = 0; i < count; ++i)
+            bigger[i] = std::move(buffer[(head + i) & (buffer.size() - 1)]);
+        buffer.swap(bigger);
+        head = 0;
+    }
+
+    std::vector<T> buffer;
+    size_t head;
+    size_t count;
+};
+
+// one deque per worker: the owner pushes and pops at the back (LIFO, hot in
+// cache), thieves take from the front (FIFO, the oldest and usually largest
+// piece of work). the lock is only contended while someone is stealing.
+template<class T>
+class WorkStealingDeque {
+public:
+    WorkStealingDeque() : approx_size(0) {}
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque &) = delete;
+
+    void push(T &&value)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        items.push_back(std::move(value));
+        approx_size.store(items.size(), std::memory_order_relaxed);
+    }
+
+    template<class It>
+    void push_bulk(It first, It last)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for(; first != last; ++first)
+            items.push_back(std::move(*first));
+        approx_size.store(items.size(), std::memory_order_relaxed);
+    }
+
+    bool pop(T &value)
+    {
+        if(approx_size.load(std::memory_order_relaxed) == 0)
+            return false;
+        std::unique_lock<std::mutex> lock(mutex);
+        if(items.empty())
+            return false;
+        value = items.pop_back();
+        approx_size.store(items.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    // FIFO end for the owner, used by queues that are not stolen from
+    bool pop_front(T &value)
+    {
+        if(approx_size.load(std::memory_order_relaxed) == 0)
+            return false;
+        std::unique_lock<std::mutex> lock(mutex);
+        if(items.empty())
+            return false;
+        value = items.pop_front();
+        approx_size.store(items.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    bool steal(T &value)
+    {
+        if(approx_size.load(std::memory_order_relaxed) == 0)
+            return false;
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if(!lock.owns_lock() || items.empty())
+            return false;
+        value = items.pop_front();
+        approx_size.store(items.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t size() const { return approx_size.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex;
+    RingDeque<T> items;
+    std::atomic<size_t> approx_size;
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#include "ThreadPool.h"
+
+// count every allocation made by the process
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+struct Capture {
+    long long a, b, c, d, e, f; // 48 bytes
+};
+
+int main()
+{
+    const size_t count = 10000;
+    std::atomic<long long> sum(0);
+    Capture capture = { 1, 2, 3, 4, 5, 6 };
+    std::vector< std::future<long long> > results;
+    results.reserve(count);
+
+    const size_t threads = 4;
+    ThreadPool pool(threads);
+
+    // warm-up with the workers held back, so the queue grows past the depth
+    // of a round and twice a round of shared states are live at once, the
+    // second half covers blocks parked in the per-thread caches. neither the
+    // queue nor the block caches have to grow after this
+    std::atomic<bool> gate(false);
+    for(size_t i = 0; i < threads; ++i)
+        pool.post([&gate] { while(!gate) std::this_thread::yield(); });
+    for(size_t i = 0; i < count; ++i)
+        pool.post([capture, &sum] { sum += capture.a + capture.f; });
+    for(size_t i = 0; i < 2 * count; ++i)
+        results.emplace_back(pool.enqueue([capture] { return capture.a + capture.f; }));
+    gate = true;
+    for(auto &&result : results)
+        sum += result.get();
+    results.clear();
+
+    // steady state, these rounds must not allocate at all
+    const int rounds = 5;
+    bool failed = false;
+    for(int round = 0; round < rounds; ++round)
+    {
+        size_t before = allocations.load();
+        for(size_t i = 0; i < count; ++i)
+            pool.post([capture, &sum] { sum += capture.a + capture.f; });
+        size_t posted = allocations.load() - before;
+
+        before = allocations.load();
+        for(size_t i = 0; i < count; ++i)
+            results.emplace_back(pool.enqueue([capture] { return capture.a + capture.f; }));
+        for(auto &&result : results)
+            sum += result.get();
+        results.clear();
+        size_t enqueued = allocations.load() - before;
+
+        std::cout << "round " << round << ": post " << (double)posted / count
+            << " allocations/task, enqueue " << (double)enqueued / count << " allocations/task" << std::endl;
+        if(posted || enqueued)
+        {
+            std::cerr << "round " << round << " allocated after warm-up: post " << posted
+                << ", enqueue " << enqueued << std::endl;
+            failed = true;
+        }
+    }
+
+    std::cout << "sum " << sum << std::endl;
+    return failed ? 1 : 0;
+}
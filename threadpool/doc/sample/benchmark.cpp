@@ -0,0 +1,59 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <string>
+
+#include "ThreadPool.h"
+
+// many tiny tasks, the cost is dominated by the queue not by the work
+static double external_submit(ThreadPool::Mode mode, size_t threads, size_t count)
+{
+    std::atomic<size_t> done(0);
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads, mode);
+        for(size_t i = 0; i < count; ++i)
+            pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+    }
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+    return count / used.count();
+}
+
+// tasks that spawn tasks, the case work stealing keeps off the global lock
+static double nested_submit(ThreadPool::Mode mode, size_t threads, size_t count)
+{
+    std::atomic<size_t> done(0);
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads, mode);
+        const size_t fanout = 64;
+        for(size_t i = 0; i < count / fanout; ++i)
+            pool.enqueue([&pool, &done, fanout] {
+                for(size_t j = 0; j < fanout; ++j)
+                    pool.enqueue([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+            });
+    }
+    std::chrono::duration<double> used = std::chrono::steady_clock::now() - start;
+    return count / used.count();
+}
+
+int main()
+{
+    const size_t count = 1000000;
+    size_t hw = std::thread::hardware_concurrency();
+    if(hw == 0) hw = 4;
+
+    for(size_t threads = 1; threads <= hw * 4; threads *= 2)
+    {
+        std::cout << threads << " threads" << std::endl;
+        std::cout << "  external fifo          " << (size_t)external_submit(ThreadPool::Mode::fifo, threads, count) << " tasks/s" << std::endl;
+        std::cout << "  external work_stealing " << (size_t)external_submit(ThreadPool::Mode::work_stealing, threads, count) << " tasks/s" << std::endl;
+        std::cout << "  external lock_free     " << (size_t)external_submit(ThreadPool::Mode::lock_free, threads, count) << " tasks/s" << std::endl;
+        std::cout << "  nested   fifo          " << (size_t)nested_submit(ThreadPool::Mode::fifo, threads, count) << " tasks/s" << std::endl;
+        std::cout << "  nested   work_stealing " << (size_t)nested_submit(ThreadPool::Mode::work_stealing, threads, count) << " tasks/s" << std::endl;
+        std::cout << "  nested   lock_free     " << (size_t)nested_submit(ThreadPool::Mode::lock_free, threads, count) << " tasks/s" << std::endl;
+    }
+
+    return 0;
+}
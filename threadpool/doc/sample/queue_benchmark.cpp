@@ -0,0 +1,140 @@
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+
+#include "MpmcQueue.h"
+#include "EventCount.h"
+
+typedef std::chrono::steady_clock clock_type;
+typedef clock_type::time_point stamp;
+
+// the old task queue of ThreadPool
+class LockedQueue {
+public:
+    void push(stamp &&value)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            items.push(value);
+        }
+        condition.notify_one();
+    }
+
+    stamp pop()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return !items.empty(); });
+        stamp value = items.front();
+        items.pop();
+        return value;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::queue<stamp> items;
+};
+
+class LockFreeQueue {
+public:
+    void push(stamp &&value)
+    {
+        items.push(std::move(value));
+        event.notify_one();
+    }
+
+    stamp pop()
+    {
+        stamp value;
+        for(;;)
+        {
+            if(items.try_pop(value))
+                return value;
+            EventCount::Key key = event.prepare_wait();
+            if(items.try_pop(value))
+            {
+                event.cancel_wait();
+                return value;
+            }
+            event.wait(key);
+        }
+    }
+
+private:
+    MpmcQueue<stamp> items;
+    EventCount event;
+};
+
+struct Result {
+    double throughput;      // items per second
+    double mean_latency;    // push to pop, microseconds
+    double max_latency;
+};
+
+// pairs producers and pairs consumers, every item carries its push time
+template<class Queue>
+static Result run(size_t pairs, size_t count)
+{
+    Queue queue;
+    size_t per_thread = count / pairs;
+    std::vector<double> total(pairs), worst(pairs);
+    std::vector<std::thread> threads;
+
+    clock_type::time_point start = clock_type::now();
+    for(size_t c = 0; c < pairs; ++c)
+        threads.emplace_back([&, c] {
+            for(size_t i = 0; i < per_thread; ++i)
+            {
+                stamp pushed = queue.pop();
+                double us = std::chrono::duration<double, std::micro>(clock_type::now() - pushed).count();
+                total[c] += us;
+                worst[c] = std::max(worst[c], us);
+            }
+        });
+    for(size_t p = 0; p < pairs; ++p)
+        threads.emplace_back([&] {
+            for(size_t i = 0; i < per_thread; ++i)
+                queue.push(clock_type::now());
+        });
+    for(auto &t : threads)
+        t.join();
+    std::chrono::duration<double> used = clock_type::now() - start;
+
+    Result r;
+    r.throughput = per_thread * pairs / used.count();
+    r.mean_latency = 0;
+    r.max_latency = 0;
+    for(size_t c = 0; c < pairs; ++c)
+    {
+        r.mean_latency += total[c];
+        r.max_latency = std::max(r.max_latency, worst[c]);
+    }
+    r.mean_latency /= per_thread * pairs;
+    return r;
+}
+
+static void print(const char *name, const Result &r)
+{
+    std::cout << "  " << name << (size_t)r.throughput << " items/s, latency mean "
+        << r.mean_latency << "us max " << r.max_latency << "us" << std::endl;
+}
+
+int main()
+{
+    const size_t count = 1 << 20;
+
+    for(size_t pairs = 1; pairs <= 64; pairs *= 2)
+    {
+        std::cout << pairs << " producer/consumer pairs" << std::endl;
+        print("std::queue + mutex ", run<LockedQueue>(pairs, count));
+        print("MpmcQueue          ", run<LockFreeQueue>(pairs, count));
+    }
+
+    return 0;
+}